@@ -73,6 +73,7 @@ AprxFairQueue::completeService()
     }
 
     applyEcnMark(*pkt);
+    addTelemetry(*pkt);
     pkt->sendOn();
 
     beginService();
@@ -0,0 +1,197 @@
+/*
+ * Convergence monitor
+ */
+#include "convergence.h"
+#include "queue.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ConvergenceMonitor::ConvergenceMonitor(Topology &topo,
+                                       simtime_picosec window,
+                                       double target)
+    : EventSource("ConvergenceMonitor"),
+    _topo(topo),
+    _window(window),
+    _target(target),
+    _start(0),
+    _end(0)
+{
+    // Fabric links follow the server facing ones.
+    uint32_t first = topo.nLinks(Topology::HOST_UP) + topo.nLinks(Topology::HOST_DOWN);
+    _txBytes.resize(topo.nLinks() - first, 0);
+}
+
+void
+ConvergenceMonitor::flowFinished(simtime_picosec start,
+                                 simtime_picosec end)
+{
+    _fcts.push_back(timeAsUs(end - start));
+}
+
+void
+ConvergenceMonitor::atStop(function<void()> report)
+{
+    _reports.push_back(report);
+}
+
+void
+ConvergenceMonitor::start(simtime_picosec startTime,
+                          simtime_picosec endTime)
+{
+    _start = startTime;
+    _end = endTime;
+    EventList::Get().sourceIsPending(*this, startTime + _window);
+}
+
+double
+ConvergenceMonitor::utilization()
+{
+    uint32_t first = _topo.nLinks() - _txBytes.size();
+    double bytes = 0, capacity = 0;
+
+    for (uint32_t i = 0; i < _txBytes.size(); i++) {
+        Queue *q = _topo.queue(first + i);
+        if (q == NULL) {
+            continue;
+        }
+        bytes += q->txBytes() - _txBytes[i];
+        capacity += q->bitrate() / 8.0 * timeAsSec(_window);
+        _txBytes[i] = q->txBytes();
+    }
+
+    return capacity > 0 ? bytes / capacity : 0;
+}
+
+ConvergenceMonitor::Estimate
+ConvergenceMonitor::estimate(const vector<double> &series)
+{
+    Estimate e = {false, 0, 0, 0};
+
+    uint32_t m = series.size() / BATCH;
+    if (m < MIN_BATCHES) {
+        return e;
+    }
+
+    vector<double> b(m, 0);
+    for (uint32_t i = 0; i < m * BATCH; i++) {
+        b[i / BATCH] += series[i] / BATCH;
+    }
+
+    // MSER: drop the first d batches for the d that minimizes the variance
+    // of the mean of the rest, looking at d up to half the batches. Sums
+    // run from the end so that each d takes constant time.
+    uint32_t d = 0;
+    double best = -1, sum = 0, sumSq = 0;
+    for (uint32_t i = m; i-- > 0; ) {
+        sum += b[i];
+        sumSq += b[i] * b[i];
+        uint32_t k = m - i;
+        if (i <= m / 2) {
+            double mser = (sumSq - sum * sum / k) / ((double)k * k);
+            if (best < 0 || mser <= best) {
+                best = mser;
+                d = i;
+            }
+        }
+    }
+
+    // The estimate stands once the warm-up ends in the first half and
+    // enough batches are left after it.
+    uint32_t k = m - d;
+    if (d >= m / 2 || k < MIN_BATCHES) {
+        return e;
+    }
+
+    sum = 0;
+    sumSq = 0;
+    for (uint32_t i = d; i < m; i++) {
+        sum += b[i];
+        sumSq += b[i] * b[i];
+    }
+    double var = max(sumSq - sum * sum / k, 0.0) / (k - 1);
+
+    // Student t quantile for a 95% interval (Cornish-Fisher expansion).
+    const double z = 1.959964;
+    double nu = k - 1;
+    double t = z + (z * z * z + z) / (4 * nu)
+        + (5 * pow(z, 5) + 16 * z * z * z + 3 * z) / (96 * nu * nu);
+
+    e.valid = true;
+    e.warmup = d * BATCH;
+    e.mean = sum / k;
+    e.halfWidth = t * sqrt(var / k);
+    return e;
+}
+
+void
+ConvergenceMonitor::doNextEvent()
+{
+    simtime_picosec now = EventList::Get().now();
+
+    // Close the window. Windows without a finished flow have no FCT.
+    if (!_fcts.empty()) {
+        sort(_fcts.begin(), _fcts.end());
+        size_t n = _fcts.size();
+
+        double mean = 0;
+        for (double fct : _fcts) {
+            mean += fct;
+        }
+        _fctMean.push_back(mean / n);
+        _fctP99.push_back(_fcts[min(n - 1, n * 99 / 100)]);
+        _fctWindow.push_back(_util.size());
+        _fcts.clear();
+    }
+    _util.push_back(utilization());
+
+    bool converged = true;
+    for (const vector<double> *series : {&_fctMean, &_fctP99, &_util}) {
+        Estimate e = estimate(*series);
+        if (!e.valid || e.halfWidth > _target * fabs(e.mean)) {
+            converged = false;
+            break;
+        }
+    }
+
+    if (converged) {
+        report("Converged");
+        for (auto &r : _reports) {
+            r();
+        }
+        EventList::Get().stop();
+        return;
+    }
+
+    if (now + _window > _end) {
+        report("NotConverged");
+        return;
+    }
+    EventList::Get().sourceIsPending(*this, now + _window);
+}
+
+void
+ConvergenceMonitor::report(const char *status)
+{
+    Estimate fct = estimate(_fctMean);
+    Estimate p99 = estimate(_fctP99);
+    Estimate util = estimate(_util);
+
+    // The FCT warm-ups count values, so end after the window of the last
+    // value dropped.
+    uint32_t warmup = util.warmup;
+    for (uint32_t w : {fct.warmup, p99.warmup}) {
+        if (w > 0) {
+            warmup = max(warmup, _fctWindow[w - 1] + 1);
+        }
+    }
+
+    cout << setprecision(6) << status
+         << " at " << lround(timeAsUs(EventList::Get().now()))
+         << " warmup " << lround(timeAsUs(_start + warmup * _window))
+         << " windows " << _util.size()
+         << " fct " << fct.mean << " +- " << fct.halfWidth
+         << " p99 " << p99.mean << " +- " << p99.halfWidth
+         << " util " << util.mean << " +- " << util.halfWidth << endl;
+}
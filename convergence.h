@@ -0,0 +1,92 @@
+/*
+ * Convergence monitor header
+ */
+#ifndef CONVERGENCE_H
+#define CONVERGENCE_H
+
+#include "eventlist.h"
+#include "topology.h"
+
+#include <functional>
+#include <vector>
+
+/*
+ * Ends a run once its results have settled.
+ *
+ * Every window the monitor records the mean and 99th percentile FCT of
+ * the flows that finished in it, and the mean utilization of the fabric
+ * links (those above the servers). Each statistic forms a series of
+ * window values, the FCT ones skipping windows in which no flow finished.
+ * MSER-5 picks the warm-up transient to drop from the start
+ * of the series, and the batch means of the rest (five windows each) give
+ * a 95% confidence interval for the steady-state value.
+ *
+ * Once every interval is within target of its mean (as a relative half
+ * width), the monitor prints a "Converged" line with the warm-up and the
+ * estimates, runs the reports due at the end time (see atStop()), and
+ * stops the simulation. A run that does not settle prints "NotConverged"
+ * with the estimates at its end time instead. Flows that started before
+ * the warm-up cut are still printed; parse_and_plot.py drops them.
+ */
+class ConvergenceMonitor : public EventSource
+{
+    public:
+        ConvergenceMonitor(Topology &topo, simtime_picosec window, double target);
+
+        // Records the FCT of a flow (or RPC) that started at start.
+        void flowFinished(simtime_picosec start, simtime_picosec end);
+
+        // Takes the first window from startTime, and gives up at endTime.
+        void start(simtime_picosec startTime, simtime_picosec endTime);
+
+        // Runs report if the monitor stops the run, in place of an end of
+        // run report whose event is then dropped. Reports run in the order
+        // they were added.
+        void atStop(std::function<void()> report);
+
+        void doNextEvent();
+
+    private:
+        // Batches of windows, the fewest batches left after the warm-up for
+        // an estimate, and the windows of each batch (the 5 of MSER-5).
+        static const uint32_t BATCH = 5;
+        static const uint32_t MIN_BATCHES = 10;
+
+        // Steady-state estimate of one series.
+        struct Estimate {
+            bool valid;            // Enough batches past the warm-up.
+            uint32_t warmup;       // Values dropped from the start.
+            double mean;
+            double halfWidth;
+        };
+
+        static Estimate estimate(const std::vector<double> &series);
+
+        // Mean utilization of the fabric links since the last window.
+        double utilization();
+
+        void report(const char *status);
+
+        Topology &_topo;
+        simtime_picosec _window;
+        double _target;
+        simtime_picosec _start;
+        simtime_picosec _end;
+
+        // FCTs in microseconds of the current window.
+        std::vector<double> _fcts;
+
+        // Window values of each statistic, and the window of each FCT
+        // value, which the FCT warm-up is counted back in.
+        std::vector<double> _fctMean;
+        std::vector<double> _fctP99;
+        std::vector<uint32_t> _fctWindow;
+        std::vector<double> _util;
+
+        // Bytes sent by each fabric link at the last window.
+        std::vector<uint64_t> _txBytes;
+
+        std::vector<std::function<void()> > _reports;
+};
+
+#endif /* CONVERGENCE_H */
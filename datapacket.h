@@ -5,19 +5,42 @@
 #define DATAPACKET_H
 
 #include "network.h"
+#include "recvbuffer.h"
 
 // DataPacket and DataAck are subclasses of Packet used by TcpSrc and other flow control protocols.
 // They incorporate a packet database, to reuse packet objects that are no longer needed.
 // Note: you never construct a new DataPacket or DataAck directly; 
 // rather you use the static method newpkt() which knows to reuse old packets from the database.
 
+// Most queues a packet crosses, endhost queue included.
+#define MAX_INT_HOPS 8
+
+// In-band telemetry one queue records on a packet as it departs (see
+// Queue::addTelemetry), and the sink echoes back on its ack.
+struct IntHop
+{
+    mem_b qlen;             // Queue occupancy.
+    uint64_t txBytes;       // Bytes the queue has sent so far.
+    simtime_picosec ts;     // Departure time.
+    linkspeed_bps rate;     // Drain rate of the queue.
+};
+
+// The hops recorded on one packet. Kept out of line and taken from a pool
+// on the first hop, so that packets without telemetry don't carry it.
+struct IntTrace : public Pooled<IntTrace>
+{
+    uint32_t n;
+    IntHop hops[MAX_INT_HOPS];
+};
+
 class DataPacket : public Packet
 {
     public:
         typedef uint64_t seq_t;
+        DataPacket() : _int(NULL) {}
         virtual ~DataPacket() {}
 
-        inline static DataPacket* newpkt(PacketFlow &flow, route_t &route, seq_t seqno, int size)
+        inline static DataPacket* newpkt(PacketFlow &flow, const Route &route, seq_t seqno, int size)
         {
             DataPacket *p = _packetdb.allocPacket();
 
@@ -38,13 +61,36 @@ class DataPacket : public Packet
         }
 
         void free() {
-            flow()._nPackets--;
+            delete _int;
+            _int = NULL;
+            flow().packetFreed();
             _packetdb.freePacket(this);
         }
 
         inline seq_t seqno() const {return _seqno;}
         inline simtime_picosec ts() const {return _ts;}
         inline void set_ts(simtime_picosec ts) {_ts = ts;}
+
+        // Telemetry of the queues crossed so far, recorded only on packets
+        // flagged Packet::INT.
+        inline uint32_t nHops() const {return _int != NULL ? _int->n : 0;}
+        inline const IntHop* hops() const {return _int != NULL ? _int->hops : NULL;}
+        inline void pushHop(const IntHop &hop) {
+            if (_int == NULL) {
+                _int = new IntTrace();
+                _int->n = 0;
+            }
+            if (_int->n < MAX_INT_HOPS) {
+                _int->hops[_int->n++] = hop;
+            }
+        }
+
+        // Hands the recorded hops over to the caller, e.g. an ack.
+        inline IntTrace* takeHops() {
+            IntTrace *t = _int;
+            _int = NULL;
+            return t;
+        }
         
         // CONGA metadata methods
         inline void setCongaMetadata(uint32_t srcLeaf, uint32_t dstLeaf) {
@@ -75,6 +121,8 @@ class DataPacket : public Packet
     protected:
         seq_t _seqno;
         simtime_picosec _ts;
+
+        IntTrace *_int;
         
         // CONGA metadata
         uint32_t _srcLeaf;
@@ -91,14 +139,18 @@ class DataAck : public Packet
     public:
         typedef DataPacket::seq_t seq_t;
 
+        DataAck() : _int(NULL) {}
         virtual ~DataAck(){}
 
-        inline static DataAck* newpkt(PacketFlow &flow, route_t &route, seq_t seqno, seq_t ackno)
+        inline static DataAck* newpkt(PacketFlow &flow, const Route &route, seq_t seqno, seq_t ackno)
         {
             DataAck *p = _packetdb.allocPacket();
             p->set(flow, route, ACK_SIZE, ackno);
             p->_seqno = seqno;
             p->_ackno = ackno;
+            p->_nSack = 0;
+            p->_grant = 0;
+            p->_grantPriority = 0;
             
             // Initialize CONGA metadata for ACKs too
             p->_srcLeaf = 0;
@@ -112,7 +164,9 @@ class DataAck : public Packet
         }
 
         void free() {
-            flow()._nPackets--;
+            delete _int;
+            _int = NULL;
+            flow().packetFreed();
             _packetdb.freePacket(this);
         }
 
@@ -120,6 +174,30 @@ class DataAck : public Packet
         inline seq_t ackno() const {return _ackno;}
         inline simtime_picosec ts() const {return _ts;}
         inline void set_ts(simtime_picosec ts) {_ts = ts;}
+
+        // SACK blocks, filled by the sink when it holds out-of-order data.
+        inline uint32_t nSack() const {return _nSack;}
+        inline const SackBlock& sack(uint32_t i) const {return _sack[i];}
+        inline SackBlock* sackBlocks() {return _sack;}
+        inline void setNSack(uint32_t n) {_nSack = n;}
+
+        // Receiver-driven grants: the sender may send up to offset, with
+        // the given priority (see HomaSink).
+        inline seq_t grant() const {return _grant;}
+        inline uint32_t grantPriority() const {return _grantPriority;}
+        inline void setGrant(seq_t offset, uint32_t priority) {
+            _grant = offset;
+            _grantPriority = priority;
+        }
+
+        // Telemetry echoed from the data packet being acked, which gives
+        // up its hops rather than copy them.
+        inline uint32_t nHops() const {return _int != NULL ? _int->n : 0;}
+        inline const IntHop* hops() const {return _int != NULL ? _int->hops : NULL;}
+        inline void setHops(DataPacket &pkt) {
+            delete _int;
+            _int = pkt.takeHops();
+        }
         
         // CONGA metadata methods for ACKs
         inline void setCongaMetadata(uint32_t srcLeaf, uint32_t dstLeaf) {
@@ -151,6 +229,14 @@ class DataAck : public Packet
         seq_t _seqno;
         seq_t _ackno;
         simtime_picosec _ts;
+
+        uint32_t _nSack;
+        SackBlock _sack[MAX_SACK_BLOCKS];
+
+        seq_t _grant;
+        uint32_t _grantPriority;
+
+        IntTrace *_int;
         
         // CONGA metadata
         uint32_t _srcLeaf;
@@ -6,8 +6,7 @@
 
 #include "loggertypes.h"
 #include "datapacket.h"
-
-#include <list>
+#include "recvbuffer.h"
 
 class DataSource;
 
@@ -19,20 +18,23 @@ class DataSink : public PacketSink, public Logged
 
         virtual void receivePacket(Packet &pkt) = 0;
 
-        void connect(DataSource &src, route_t &route);
+        // Named after its source on first use (see DataSource::str()).
+        const std::string& str();
+
+        void connect(DataSource &src, const Route &route);
         void processDataPacket(DataPacket &pkt);
 
-        DataAck::seq_t cumulative_ack();
+        inline DataAck::seq_t cumulative_ack() {return _received.cumulativeAck();}
         uint32_t drops();
 
-        DataAck::seq_t _cumulative_ack;
-        std::list<std::pair<DataAck::seq_t,mem_b> > _received;
+        // Out-of-order segments and the cumulative ack.
+        ReceiveBuffer _received;
 
         uint32_t _node_id;
 
     protected:
         DataSource *_src;
-        route_t *_route;  // Back to source.
+        const Route *_route;  // Back to source.
 };
 
 #endif /* DATASINK_h*/
@@ -2,23 +2,29 @@
  * DataSource
  */
 #include "datasource.h"
+#include "flow-generator.h"
 
 using namespace std;
 
 DataSource::DataSource(TrafficLogger *logger, 
                        uint64_t flowsize, 
                        simtime_picosec duration)
-                      : EventSource("datasource"),
+                      : EventSource(""),
                       _flowsize(flowsize),
-                      _duration(duration),
-                      _start_time(0),
-                      _deadline(0),
                       _packets_sent(0),
                       _highest_sent(0),
                       _last_acked(0),
+                      _deadline(0),
                       _enable_deadline(false),
+                      _flow(logger),
+                      _duration(duration),
+                      _start_time(0),
+                      _endhost_queue(NULL),
+                      _nic(NULL),
                       _flowgen(NULL),
-                      _flow(logger)
+                      _index(0),
+                      _wakeup_at(0),
+                      _routeEpoch(Topology::routeEpoch())
 {
     // constructor
 }
@@ -29,6 +35,15 @@ DataSource::setFlowGenerator(FlowGenerator *flowgen)
     _flowgen = flowgen;
 }
 
+const string&
+DataSource::str()
+{
+    if (Logged::str().empty()) {
+        setName(_flowgen != NULL ? _flowgen->prefix() + "src" + to_string(_index) : "datasource");
+    }
+    return Logged::str();
+}
+
 void 
 DataSource::setDeadline(simtime_picosec deadline)
 {
@@ -37,22 +52,51 @@ DataSource::setDeadline(simtime_picosec deadline)
 
 void 
 DataSource::connect(simtime_picosec start_time, 
-                    route_t &route_fwd, 
-                    route_t &route_rev, 
+                    const route_t &route_fwd, 
+                    const route_t &route_rev, 
                     DataSink &sink)
 {
-    _route_fwd = &route_fwd;
-    _route_rev  = &route_rev;
+    _sink = &sink;
+    setRoutes(route_fwd, route_rev);
 
     _start_time = start_time;
 
-    _sink = &sink;
-
     _flow.id = id; // identify the packet flow with the datasource that generated it
+    _flow._size = _flowsize;
 
     // Ming added _flowsize
     // cout << str() << " " << timeAsUs(_start_time) << " " << id << " " << _flowsize << " " << _node_id << " " << _sink->_node_id << endl;
 
-    _sink->connect(*this, *_route_rev);
+    _sink->connect(*this, _route_rev);
+    _wakeup_at = _start_time;
     EventList::Get().sourceIsPending(*this, _start_time);
 }
+
+void
+DataSource::setRoutes(const route_t &route_fwd,
+                      const route_t &route_rev)
+{
+    // The sink acks along _route_rev, so it follows too.
+    _route_fwd = Route(route_fwd, _sink, _endhost_queue != NULL ? _endhost_queue : _nic);
+    _route_rev = Route(route_rev, this);
+    _routeEpoch = Topology::routeEpoch();
+}
+
+void
+DataSource::refreshRoutes()
+{
+    if (_flowgen != NULL && _routeEpoch != Topology::routeEpoch()) {
+        _flowgen->refreshRoutes(*this);
+    }
+}
+
+void
+DataSource::release()
+{
+    if (_wakeup_at != 0) {
+        EventList::Get().cancelPending(*this, _wakeup_at);
+    }
+    delete _sink;
+    delete _endhost_queue;
+    delete this;
+}
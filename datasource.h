@@ -25,36 +25,74 @@ class DataSource : public EventSource, public PacketSink
             DCTCP,    // Datacenter TCP
             D_TCP,    // Deadline TCP
             D_DCTCP,  // Deadline DCTCP
+            CUBIC,    // TCP CUBIC
             PKTPAIR,  // Packet pair
-            TIMELY
+            TIMELY,
+            HOMA,     // Receiver-driven (Homa/pHost style)
+            HPCC,     // Telemetry-driven window control
+            SWIFT     // Delay target scaled by hop count
         };
 
         virtual void printStatus() = 0;
         virtual void doNextEvent() = 0;
         virtual void receivePacket(Packet &pkt) = 0;
 
-        void connect(simtime_picosec start_time, route_t &route_fwd, route_t &route_rev, DataSink &sink);
+        /* Routes end at the sink and back at this source; _endhost_queue or
+         * else _nic, if set, is the first hop of the forward route. */
+        void connect(simtime_picosec start_time, const route_t &route_fwd,
+                const route_t &route_rev, DataSink &sink);
+
+        /* Points the flow at new hop lists; packets already sent keep theirs. */
+        void setRoutes(const route_t &route_fwd, const route_t &route_rev);
+
+        /* After a link event moved routes (see Topology::routeEpoch()), asks
+         * the flow generator for the flow's routes again. Called on
+         * retransmission timeouts, so that a flow stuck on a failed path
+         * moves off it. */
+        void refreshRoutes();
 
         void setFlowGenerator(FlowGenerator *flowgen);
         void setDeadline(simtime_picosec deadline);
 
-        uint64_t _flowsize;
-        simtime_picosec _duration;
-        simtime_picosec _start_time;
-        simtime_picosec _deadline;
+        /* Frees a finished flow with no packets left: its sink, endhost
+         * queue and the source itself, after cancelling the source's event
+         * at _wakeup_at. For sources that keep a single event pending. */
+        void release();
+
+        /* Flows from a FlowGenerator are named from its prefix and _index
+         * the first time the name is asked for, not when they are created. */
+        const std::string& str();
 
+        // Per-packet state first, so that the ACK path touches few lines.
+        uint64_t _flowsize;
         uint64_t _packets_sent;
         uint64_t _highest_sent;
         uint64_t _last_acked;
 
+        simtime_picosec _deadline;
         bool _enable_deadline;
 
+        Route _route_fwd;
+        Route _route_rev;
+        PacketFlow _flow;
+
+        // Set up once per flow.
+        simtime_picosec _duration;
+        simtime_picosec _start_time;
+
         DataSink *_sink;
-        route_t *_route_fwd;
-        route_t *_route_rev;
+
+        // Per-flow endhost queue at the head of _route_fwd, owned by the flow.
+        PacketSink *_endhost_queue;
+
+        // Otherwise the NIC of the sending host, shared with its other flows.
+        PacketSink *_nic;
 
         FlowGenerator *_flowgen;
-        PacketFlow _flow;
+        uint32_t _index;              // Flow number within _flowgen.
+
+        simtime_picosec _wakeup_at;   // Source's own pending event, 0 if none.
+        uint32_t _routeEpoch;         // Topology::routeEpoch() of the routes.
 
         uint32_t _node_id;
 };
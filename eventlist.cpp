@@ -25,6 +25,13 @@ EventList::setEndtime(simtime_picosec endtime)
     _endtime = endtime;
 }
 
+void
+EventList::stop()
+{
+    _pendingsources.clear();
+    _endtime = _lasteventtime;
+}
+
 bool
 EventList::doNextEvent() 
 {
@@ -80,3 +87,17 @@ EventList::sourceIsPending(EventSource &src,
         _pendingsources.insert(make_pair(when, &src));
     }
 }
+
+bool
+EventList::cancelPending(EventSource &src,
+                         simtime_picosec when)
+{
+    auto range = _pendingsources.equal_range(when);
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second == &src) {
+            _pendingsources.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
@@ -28,6 +28,10 @@ class EventList
         // End simulation at endtime (rather than forever)
         void setEndtime(simtime_picosec endtime);
 
+        // Ends the simulation once the current event is done, dropping the
+        // events still pending.
+        void stop();
+
         // Returns true if it did anything, false if there's nothing to do.
         bool doNextEvent();
 
@@ -38,6 +42,9 @@ class EventList
             sourceIsPending(src, now() + timefromnow);
         }
 
+        // Removes an event of src due at when. Returns false if there is none.
+        bool cancelPending(EventSource &src, simtime_picosec when);
+
         // Returns current simulation time.
         inline simtime_picosec now() {return _lasteventtime;}
 
@@ -6,7 +6,7 @@ using namespace std;
 
 FairQueue::FairQueue(linkspeed_bps bitrate, mem_b maxsize, QueueLogger *logger)
     : Queue(bitrate, maxsize, logger), _roundUpdate(0),
-      _nActiveFlows(0), _roundNumber(0), _exactRoundNumber(0.0)
+      _nActiveFlows(0), _roundNumber(0), _exactRoundNumber(0.0), _currentPkt(NULL)
 {
     _mode = LAZY;
 }
@@ -61,6 +61,7 @@ FairQueue::completeService()
 
     // Fair-queue shouldn't need ECN marks as it drops the most "unfair" packet.
     applyEcnMark(*_currentPkt);
+    addTelemetry(*_currentPkt);
     _currentPkt->sendOn();
 
     // Clear packet being transmitted.
@@ -150,7 +151,7 @@ void
 FairQueue::updateRoundNumber()
 {
     // Calculate link rate in bytes per picosec.
-    static double LinkRate = (_bitrate / 8.0) / 1000000000000.0;
+    double LinkRate = (_bitrate / 8.0) / 1000000000000.0;
 
     while (_nActiveFlows > 0) {
         // Find the lowest finish round number of any active flow.
@@ -3,29 +3,51 @@
  */
 #include "flow-generator.h"
 
+#include <algorithm>
+
 using namespace std;
 
 FlowGenerator::FlowGenerator(DataSource::EndHost endhost, 
                              route_gen_t rg,
                              linkspeed_bps flowRate, 
                              uint32_t avgFlowSize, 
-                             Workloads::FlowDist flowSizeDist)
+                             const string &flowSizeDist)
     : EventSource("FlowGen"),
     _prefix(""),
     _endhost(endhost),
     _routeGen(rg),
     _flowRate(flowRate),
-    _flowSizeDist(flowSizeDist),
     _flowsGenerated(0),
     _workload(avgFlowSize, flowSizeDist),
     _endhostQ(false),
+    _hostNic(false),
+    _nicSched(HostNic::FIFO),
+    _reorderTolerant(false),
+    _delackSegs(1),
+    _delackTimeout(0),
+    _sack(false),
+    _paceQuantum(0),
     _useTrace(false),
     _replaceFlow(false),
     _maxFlows(0),
     _concurrentFlows(0),
     _avgOffTime(0),
-    _flowTrace(),
-    _liveFlows()
+    _liveFlows(),
+    _tm(NULL),
+    _coflowsGenerated(0),
+    _schedule(NULL),
+    _baseLoad(1),
+    _monitor(NULL),
+    _nHosts(0),
+    _hostsPerRack(0),
+    _localRatio(0),
+    _batchNext(0),
+    _batchSize(0),
+    _batchHosts(0),
+    _rpcHosts(0),
+    _rpcOutstanding(0),
+    _rpcRequest(0),
+    _pool(false)
 {
     double flowsPerSec = _flowRate / (_workload._avgFlowSize * 8.0);
     _avgFlowArrivalTime = timeFromSec(1) / flowsPerSec;
@@ -35,13 +57,69 @@ void
 FlowGenerator::setTimeLimits(simtime_picosec startTime, 
                              simtime_picosec endTime)
 {
-    if (_useTrace) {
-        EventList::Get().sourceIsPending(*this, _flowTrace.front().first);
+    _endTime = endTime;
+
+    // Per-host arrivals pick their own hosts and times. A traffic pattern
+    // runs in a generator of its own (see the experiments).
+    if (_nHosts > 0 && (_useTrace || _tm != NULL || _rpcOutstanding > 0)) {
+        fprintf(stderr, "Per-host arrivals can't be combined with a trace, "
+                "a traffic matrix or RPCs in one generator\n");
+        exit(1);
+    }
+
+    // Pooled flows never end a connection, so can't replace one another.
+    if (_pool && _replaceFlow) {
+        fprintf(stderr, "Pooled connections can't be combined with replaced flows\n");
+        exit(1);
+    }
+
+    // Arrivals shaped by a pattern or a varying load are drawn one at a time.
+    if (_useTrace || _tm != NULL || _schedule != NULL || _nHosts > 0) {
+        _batchSize = 0;
+    }
+
+    if (_rpcOutstanding > 0) {
+        // Clients open all their RPCs at once; the connections they set up
+        // start within a few microseconds of each other.
+        for (uint32_t client = 0; client < _rpcHosts; client++) {
+            for (uint32_t i = 0; i < _rpcOutstanding; i++) {
+                startRpc(client);
+            }
+        }
+    } else if (_useTrace) {
+        if (_flowTrace.valid()) {
+            EventList::Get().sourceIsPending(*this, timeFromNs(_flowTrace.current().delta));
+        }
+    } else if (_nHosts > 0) {
+        // Hosts share the generator's rate, scaled by their rack's load.
+        uint32_t nRacks = _nHosts / _hostsPerRack;
+        uint64_t seed = rand();
+        for (uint32_t p = 0; p < _partitions.size(); p++) {
+            _partitions[p].wheel = new HostPacer();
+            _partitions[p].rng.seed(seed + p);
+        }
+
+        for (uint32_t host = 0; host < _nHosts; host++) {
+            uint32_t rack = host / _hostsPerRack;
+            double load = (rack < _rackLoad.size()) ? _rackLoad[rack] : 1;
+            if (load <= 0) {
+                continue;
+            }
+
+            uint32_t partition = (uint64_t)rack * _partitions.size() / nRacks;
+            HostArrivals *arrivals = new HostArrivals(*this, host, partition,
+                    (double)_avgFlowArrivalTime * _nHosts / load);
+            arrivals->start(startTime);
+            _hostArrivals.push_back(arrivals);
+        }
+    } else if (_batchSize > 0) {
+        _batchRng.seed(rand());
+        refillBatch(startTime);
+        EventList::Get().sourceIsPending(*this, _batch[0].arrival);
     } else {
         EventList::Get().sourceIsPending(*this, startTime);
     }
     EventList::Get().sourceIsPending(*this, endTime);
-    _endTime = endTime;
 }
 
 void
@@ -53,6 +131,18 @@ FlowGenerator::setEndhostQueue(linkspeed_bps qRate,
     _endhostQbuffer = qBuffer;
 }
 
+void
+FlowGenerator::setHostNic(linkspeed_bps qRate,
+                          uint64_t qBuffer,
+                          HostNic::Scheduler sched)
+{
+    _endhostQ = false;
+    _hostNic = true;
+    _endhostQrate = qRate;
+    _endhostQbuffer = qBuffer;
+    _nicSched = sched;
+}
+
 void
 FlowGenerator::setReplaceFlow(uint32_t maxFlows, 
                               double offRatio)
@@ -66,6 +156,32 @@ FlowGenerator::setReplaceFlow(uint32_t maxFlows,
     _avgOffTime = llround(timeFromSec(avgFCT) * offRatio / (1 + offRatio));
 }
 
+void
+FlowGenerator::setReorderTolerance(bool enable)
+{
+    _reorderTolerant = enable;
+}
+
+void
+FlowGenerator::setDelayedAck(uint32_t segs,
+                             simtime_picosec timeout)
+{
+    _delackSegs = segs;
+    _delackTimeout = timeout;
+}
+
+void
+FlowGenerator::setSack(bool enable)
+{
+    _sack = enable;
+}
+
+void
+FlowGenerator::setPacing(uint32_t quantum)
+{
+    _paceQuantum = quantum;
+}
+
 void
 FlowGenerator::setPrefix(string prefix)
 {
@@ -76,56 +192,213 @@ void
 FlowGenerator::setTrace(string filename)
 {
     _useTrace = true;
+    _flowTrace.open(filename);
+}
 
-    FILE *fp = fopen(filename.c_str(), "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Error opening trace file: %s\n", filename.c_str());
-        exit(1);
+void
+FlowGenerator::setTrafficMatrix(TrafficMatrix *tm)
+{
+    _tm = tm;
+
+    double flowsPerSec = _flowRate / (_workload._avgFlowSize * 8.0);
+    _avgFlowArrivalTime = timeFromSec(1) * tm->flowsPerArrival() / flowsPerSec;
+}
+
+void
+FlowGenerator::setLoadSchedule(LoadSchedule *schedule,
+                               double base)
+{
+    _schedule = schedule;
+    _baseLoad = base;
+}
+
+void
+FlowGenerator::setHostArrivals(uint32_t nHosts,
+                               uint32_t hostsPerRack,
+                               double localRatio,
+                               uint32_t nPartitions)
+{
+    assert(nHosts >= 2 && nHosts % hostsPerRack == 0);
+
+    _nHosts = nHosts;
+    _hostsPerRack = hostsPerRack;
+    _localRatio = (localRatio < 0) ? (hostsPerRack - 1.0) / (nHosts - 1) : localRatio;
+    _partitions.resize(max(1u, min(nPartitions, nHosts / hostsPerRack)));
+}
+
+void
+FlowGenerator::setRackLoads(const string &list)
+{
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) {
+            end = list.size();
+        }
+
+        string item = list.substr(start, end - start);
+        size_t colon = item.find(':');
+        if (colon == string::npos) {
+            fprintf(stderr, "Rack load needs a rack and a scale: %s\n", item.c_str());
+            exit(1);
+        }
+
+        uint32_t rack = stoul(item.substr(0, colon));
+        if (rack >= _rackLoad.size()) {
+            _rackLoad.resize(rack + 1, 1);
+        }
+        _rackLoad[rack] = stod(item.substr(colon + 1));
+
+        start = end + 1;
     }
+}
+
+double
+FlowGenerator::uniform(uint32_t partition)
+{
+    return unit(_partitions[partition].rng());
+}
+
+void
+FlowGenerator::setBatchArrivals(uint32_t blockSize,
+                                uint32_t nHosts)
+{
+    _batchSize = max(blockSize, 1u);
+    _batchHosts = (nHosts >= 2) ? nHosts : 0;
+}
+
+void
+FlowGenerator::setRpc(uint32_t nHosts,
+                      uint32_t outstanding,
+                      uint64_t requestSize)
+{
+    assert(nHosts >= 2);
+
+    _rpcHosts = nHosts;
+    _rpcOutstanding = outstanding;
+    _rpcRequest = max(requestSize, (uint64_t)1);
+}
 
-    uint32_t fid;
-    uint32_t fsize;
-    uint64_t fstart;
+void
+FlowGenerator::setConnectionPool(bool enable)
+{
+    _pool = enable;
+}
 
-    /* Assumes the file is sorted by flow arrival. */
-    while (fscanf(fp, "flow-%u %lu %*lu %u %*lu %*lu ", &fid, &fstart, &fsize) != EOF) {
-        _flowTrace.push_back(make_pair(timeFromUs(fstart), fsize));
+void
+FlowGenerator::setMonitor(ConvergenceMonitor *monitor)
+{
+    _monitor = monitor;
+    if (monitor != NULL) {
+        monitor->atStop([this] {endOfRun();});
     }
+}
 
-    fclose(fp);
+void
+FlowGenerator::refillBatch(simtime_picosec last)
+{
+    // All the raw draws of the block in one pass, then turned into flows:
+    // gap, size, jitter and two for the hosts per arrival.
+    const uint32_t DRAWS = 5;
+    _draws.resize(_batchSize * DRAWS);
+    for (uint64_t &r : _draws) {
+        r = _batchRng();
+    }
+
+    _batch.resize(_batchSize);
+    for (uint32_t i = 0; i < _batchSize; i++) {
+        const uint64_t *r = &_draws[i * DRAWS];
+        FlowDesc &d = _batch[i];
+
+        last += (simtime_picosec)(-log(unit(r[0])) * _avgFlowArrivalTime);
+        d.arrival = last;
+        d.size = _workload.flowSize(unit(r[1]));
+        d.jitter = llround(unit(r[2]) * timeFromUs(5));
+
+        if (_batchHosts > 0) {
+            d.dst = r[3] % _batchHosts;
+            d.src = r[4] % (_batchHosts - 1);
+            if (d.src >= d.dst) {
+                d.src++;
+            }
+        } else {
+            d.src = d.dst = TRACE_ANY_HOST;
+        }
+    }
+    _batchNext = 0;
+}
+
+void
+FlowGenerator::createHostArrival(uint32_t host,
+                                 uint32_t partition)
+{
+    std::mt19937_64 &rng = _partitions[partition].rng;
+    uint32_t nRacks = _nHosts / _hostsPerRack;
+    uint32_t rack = host / _hostsPerRack;
+
+    // Another host of the rack, or any host of another rack.
+    uint32_t dst;
+    if (_hostsPerRack > 1 && (nRacks == 1 || uniform(partition) < _localRatio)) {
+        dst = rack * _hostsPerRack + rng() % (_hostsPerRack - 1);
+        if (dst >= host) {
+            dst++;
+        }
+    } else {
+        uint32_t dstRack = rng() % (nRacks - 1);
+        if (dstRack >= rack) {
+            dstRack++;
+        }
+        dst = dstRack * _hostsPerRack + rng() % _hostsPerRack;
+    }
+
+    createFlow(_workload.flowSize(uniform(partition)), 0, host, dst);
+    _concurrentFlows++;
 }
 
 void
 FlowGenerator::doNextEvent()
 {
     if (EventList::Get().now() == _endTime) {
-        dumpLiveFlows();
+        endOfRun();
         return;
     }
 
-    // Get flowsize from given distriubtion or trace.
-    uint64_t flowSize;
-
+    // Create the flow, with size from given distriubtion or trace.
     if (_useTrace) {
-        flowSize = _flowTrace.front().second;
-        _flowTrace.pop_front();
+        const TraceRecord &r = _flowTrace.current();
+        createFlow(r.size, 0, r.src, r.dst);
+        _flowTrace.advance();
+    } else if (_tm != NULL) {
+        createArrival();
+    } else if (_batchSize > 0) {
+        const FlowDesc &d = _batch[_batchNext++];
+        createFlow(d.size, d.jitter, d.src, d.dst, false);
+        if (_batchNext == _batch.size()) {
+            refillBatch(d.arrival);
+        }
     } else {
-        flowSize = _workload.generateFlowSize();
+        createFlow(_workload.generateFlowSize(), 0);
     }
-
-    // Create the flow.
-    createFlow(flowSize, 0);
     _concurrentFlows++;
 
     // Get next flow arrival from given distriubtion or trace.
     simtime_picosec nextFlowArrival;
 
     if (_useTrace) {
-        if (_flowTrace.size() > 0) {
-            nextFlowArrival = _flowTrace.front().first - EventList::Get().now();
+        if (_flowTrace.valid()) {
+            nextFlowArrival = timeFromNs(_flowTrace.current().delta);
         } else {
             return;
         }
+    } else if (_batchSize > 0) {
+        nextFlowArrival = _batch[_batchNext].arrival - EventList::Get().now();
+    } else if (_schedule != NULL) {
+        simtime_picosec now = EventList::Get().now();
+        simtime_picosec next = _schedule->nextArrival(now, _avgFlowArrivalTime, _baseLoad);
+        if (next >= _endTime) {
+            return;
+        }
+        nextFlowArrival = next - now;
     } else {
         nextFlowArrival = exponential(1.0/_avgFlowArrivalTime);
     }
@@ -137,22 +410,59 @@ FlowGenerator::doNextEvent()
 }
 
 void
+FlowGenerator::createArrival()
+{
+    _tm->next(_arrival);
+
+    Coflow *job = NULL;
+    if (_tm->isJob()) {
+        job = new Coflow();
+        job->id = _coflowsGenerated++;
+        job->nFlows = _arrival.size();
+        job->remaining = _arrival.size();
+        job->bytes = 0;
+        job->start = EventList::Get().now();
+    }
+
+    for (auto &hosts : _arrival) {
+        uint64_t flowSize = _workload.generateFlowSize();
+        DataSource *src = createFlow(flowSize, 0, hosts.first, hosts.second);
+        if (job != NULL) {
+            job->bytes += flowSize;
+            _coflows[src->id] = job;
+        }
+    }
+}
+
+DataSource*
 FlowGenerator::createFlow(uint64_t flowSize, 
-                          simtime_picosec startTime)
+                          simtime_picosec startTime,
+                          uint32_t srcHost,
+                          uint32_t dstHost,
+                          bool jitter)
 {
-    // Generate a random route.
-    route_t *routeFwd = NULL, *routeRev = NULL;
-    uint32_t src_node = 0, dst_node = 0;
+    if (_pool && (_tm == NULL || !_tm->isJob())) {
+        sendPooled(flowSize, srcHost, dstHost);
+        _flowsGenerated++;
+        return NULL;
+    }
+
+    // Generate a route, random unless the hosts are given.
+    const route_t *routeFwd = NULL, *routeRev = NULL;
+    uint32_t src_node = srcHost, dst_node = dstHost;
     _routeGen(routeFwd, routeRev, src_node, dst_node);
 
     // Generate next start time adding jitter.
-    simtime_picosec start_time = EventList::Get().now() + startTime + llround(drand() * timeFromUs(5));
+    simtime_picosec start_time = EventList::Get().now() + startTime;
+    if (jitter) {
+        start_time += llround(drand() * timeFromUs(5));
+    }
     simtime_picosec deadline = timeFromSec((flowSize * 8.0) / speedFromGbps(0.8));
 
-    // If flag set, append an endhost queue.
+    // If flag set, put an endhost queue in front; the source frees it when done.
+    Queue *endhostQ = NULL;
     if (_endhostQ) {
-        Queue *endhostQ = new Queue(_endhostQrate, _endhostQbuffer, NULL);
-        routeFwd->insert(routeFwd->begin(), endhostQ);
+        endhostQ = new Queue(_endhostQrate, _endhostQbuffer, NULL);
     }
 
     DataSource *src;
@@ -166,16 +476,40 @@ FlowGenerator::createFlow(uint64_t flowSize,
 
         case DataSource::TIMELY:
             src = new TimelySrc(NULL, flowSize);
+            ((TimelySrc*)src)->_pacer = &HostPacer::forHost(src_node);
             snk = new TimelySink();
             break;
 
+        case DataSource::HOMA:
+            src = new HomaSrc(NULL, flowSize);
+            snk = new HomaSink();
+            break;
+
+        case DataSource::HPCC:
+        case DataSource::SWIFT:
+            src = new HpccSrc(NULL, flowSize,
+                    _endhost == DataSource::HPCC ? HpccSrc::HPCC : HpccSrc::SWIFT);
+            snk = new HpccSink();
+            break;
+
         default: { // TCP variant
                      // TODO: option to supply logtcp.
-                     src = new TcpSrc(NULL, NULL, flowSize);
-                     snk = new TcpSink();
+                     TcpSrc *tcpSrc = new TcpSrc(NULL, NULL, flowSize);
+                     tcpSrc->_reorder_tolerant = _reorderTolerant;
+                     tcpSrc->_sack = _sack;
+                     if (_paceQuantum > 0) {
+                         tcpSrc->setPacing(_paceQuantum, HostPacer::forHost(src_node));
+                     }
+                     src = tcpSrc;
+
+                     TcpSink *tcpSnk = new TcpSink();
+                     tcpSnk->setDelayedAck(_delackSegs, _delackTimeout);
+                     snk = tcpSnk;
 
                      if (_endhost == DataSource::DCTCP || _endhost == DataSource::D_DCTCP) {
-                         TcpSrc::_enable_dctcp = true;
+                         tcpSrc->_cc = TcpSrc::CC_DCTCP;
+                     } else if (_endhost == DataSource::CUBIC) {
+                         tcpSrc->_cc = TcpSrc::CC_CUBIC;
                      }
 
                      if (_endhost == DataSource::D_TCP || _endhost == DataSource::D_DCTCP) {
@@ -184,29 +518,280 @@ FlowGenerator::createFlow(uint64_t flowSize,
                  }
     }
 
-    src->setName(_prefix + "src" + to_string(_flowsGenerated));
-    snk->setName(_prefix + "snk" + to_string(_flowsGenerated));
+    src->_index = _flowsGenerated;
     src->_node_id = src_node;
     snk->_node_id = dst_node;
+    src->_endhost_queue = endhostQ;
+    if (_hostNic) {
+        src->_nic = &HostNic::forHost(src_node, _endhostQrate, _endhostQbuffer, _nicSched);
+    }
 
     src->setDeadline(start_time + deadline);
 
-    routeFwd->push_back(snk);
-    routeRev->push_back(src);
     src->connect(start_time, *routeFwd, *routeRev, *snk);
     src->setFlowGenerator(this);
 
     _liveFlows[src->id] = src;
 
     _flowsGenerated++;
+    return src;
+}
+
+TcpSrc*
+FlowGenerator::createConnection(uint32_t srcHost,
+                                uint32_t dstHost,
+                                simtime_picosec startTime,
+                                TcpSrc::MessageHandler handler)
+{
+    const route_t *routeFwd = NULL, *routeRev = NULL;
+    uint32_t src_node = srcHost, dst_node = dstHost;
+    _routeGen(routeFwd, routeRev, src_node, dst_node);
+
+    return createConnection(routeFwd, routeRev, src_node, dst_node, startTime, handler);
+}
+
+TcpSrc*
+FlowGenerator::createConnection(const route_t *routeFwd,
+                                const route_t *routeRev,
+                                uint32_t srcNode,
+                                uint32_t dstNode,
+                                simtime_picosec startTime,
+                                TcpSrc::MessageHandler handler,
+                                bool onAck)
+{
+    if (_endhost == DataSource::PKTPAIR || _endhost == DataSource::TIMELY ||
+            _endhost == DataSource::HOMA || _endhost == DataSource::HPCC ||
+            _endhost == DataSource::SWIFT) {
+        fprintf(stderr, "Persistent connections need a TCP endhost\n");
+        exit(1);
+    }
+
+    TcpSrc *src = new TcpSrc(NULL, NULL, 0);
+    src->setPersistent(handler, onAck);
+    src->_reorder_tolerant = _reorderTolerant;
+    src->_sack = _sack;
+    if (_paceQuantum > 0) {
+        src->setPacing(_paceQuantum, HostPacer::forHost(srcNode));
+    }
+    if (_endhost == DataSource::DCTCP || _endhost == DataSource::D_DCTCP) {
+        src->_cc = TcpSrc::CC_DCTCP;
+    } else if (_endhost == DataSource::CUBIC) {
+        src->_cc = TcpSrc::CC_CUBIC;
+    }
+
+    TcpSink *snk = new TcpSink();
+    snk->setDelayedAck(_delackSegs, _delackTimeout);
+
+    src->_index = _flowsGenerated++;
+    src->_node_id = srcNode;
+    snk->_node_id = dstNode;
+    if (_endhostQ) {
+        src->_endhost_queue = new Queue(_endhostQrate, _endhostQbuffer, NULL);
+    }
+    if (_hostNic) {
+        src->_nic = &HostNic::forHost(srcNode, _endhostQrate, _endhostQbuffer, _nicSched);
+    }
+
+    src->connect(startTime, *routeFwd, *routeRev, *snk);
+    src->setFlowGenerator(this);
+    return src;
+}
+
+void
+FlowGenerator::sendPooled(uint64_t flowSize,
+                          uint32_t srcHost,
+                          uint32_t dstHost)
+{
+    simtime_picosec now = EventList::Get().now();
+
+    // A busy connection keeps its route, so its flows make no path choice.
+    TcpSrc *conn = NULL;
+    if (srcHost != TRACE_ANY_HOST && dstHost != TRACE_ANY_HOST) {
+        auto it = _connections.find(((uint64_t)srcHost << 32) | dstHost);
+        if (it != _connections.end() && !it->second->idle()) {
+            conn = it->second;
+        }
+    }
+
+    // Otherwise the route is generated as for a one-off flow (picking the
+    // hosts if not given), and an idle connection switches to it, with no
+    // packet of its in flight to be reordered.
+    if (conn == NULL) {
+        const route_t *routeFwd = NULL, *routeRev = NULL;
+        _routeGen(routeFwd, routeRev, srcHost, dstHost);
+
+        TcpSrc *&pairConn = _connections[((uint64_t)srcHost << 32) | dstHost];
+        if (pairConn == NULL) {
+            pairConn = createConnection(routeFwd, routeRev, srcHost, dstHost, now,
+                    [this](uint64_t flow) {pooledFlowDone(flow);}, true);
+        } else if (pairConn->idle()) {
+            pairConn->setRoutes(*routeFwd, *routeRev);
+        }
+        conn = pairConn;
+    }
+
+    PooledFlow &f = _pooledFlows[_flowsGenerated];
+    f.size = flowSize;
+    f.start = now;
+    f.conn = conn;
+    conn->sendMessage(flowSize, _flowsGenerated);
+}
+
+void
+FlowGenerator::pooledFlowDone(uint64_t flow)
+{
+    simtime_picosec now = EventList::Get().now();
+
+    auto it = _pooledFlows.find(flow);
+    PooledFlow f = it->second;
+    _pooledFlows.erase(it);
+
+    if (_schedule != NULL) {
+        _schedule->flowFinished(f.start, now);
+    }
+    if (_monitor != NULL) {
+        _monitor->flowFinished(f.start, now);
+    }
+
+    cout << setprecision(6) << "Flow " << _prefix << "src" << flow << " " << f.conn->id
+         << " size " << f.size
+         << " start " << lround(timeAsUs(f.start)) << " end " << lround(timeAsUs(now))
+         << " fct " << timeAsUs(now - f.start)
+         << " tput " << f.size * 8000.0 / (now - f.start)
+         << " rtt " << timeAsUs(f.conn->_rtt)
+         << " cwnd " << f.conn->_cwnd
+         << " alpha " << f.conn->_alpha << endl;
+}
+
+void
+FlowGenerator::startRpc(uint32_t client)
+{
+    uint32_t server = rand() % (_rpcHosts - 1);
+    if (server >= client) {
+        server++;
+    }
+
+    uint32_t id;
+    if (_rpcFree.empty()) {
+        id = _rpcs.size();
+        _rpcs.push_back(Rpc());
+    } else {
+        id = _rpcFree.back();
+        _rpcFree.pop_back();
+    }
+
+    // Both connections of a pair are set up with its first RPC.
+    uint64_t key = (uint64_t)client * _rpcHosts + server;
+    auto channel = _rpcChannels.find(key);
+    if (channel == _rpcChannels.end()) {
+        simtime_picosec start = EventList::Get().now() + llround(drand() * timeFromUs(5));
+        RpcChannel c;
+        c.request = createConnection(client, server, start,
+                [this](uint64_t rpc) {rpcRequestDone(rpc);});
+        c.response = createConnection(server, client, start,
+                [this](uint64_t rpc) {rpcResponseDone(rpc);});
+        channel = _rpcChannels.emplace(key, c).first;
+    }
+
+    Rpc &rpc = _rpcs[id];
+    rpc.client = client;
+    rpc.server = server;
+    rpc.size = _workload.generateFlowSize();
+    rpc.start = max(EventList::Get().now(), channel->second.request->_start_time);
+
+    channel->second.request->sendMessage(_rpcRequest, id);
+}
+
+void
+FlowGenerator::rpcRequestDone(uint64_t id)
+{
+    const Rpc &rpc = _rpcs[id];
+    uint64_t key = (uint64_t)rpc.client * _rpcHosts + rpc.server;
+    _rpcChannels[key].response->sendMessage(rpc.size, id);
+}
+
+void
+FlowGenerator::rpcResponseDone(uint64_t id)
+{
+    simtime_picosec now = EventList::Get().now();
+    const Rpc &rpc = _rpcs[id];
+
+    // Size classes by decade, from up to 10KB to over 10MB.
+    uint32_t sizeClass = 0;
+    for (uint64_t bound = 10000; rpc.size > bound && sizeClass < 4; bound *= 10) {
+        sizeClass++;
+    }
+    if (sizeClass >= _rpcLatency.size()) {
+        _rpcLatency.resize(sizeClass + 1);
+    }
+    _rpcLatency[sizeClass].push_back(timeAsUs(now - rpc.start));
+    if (_monitor != NULL) {
+        _monitor->flowFinished(rpc.start, now);
+    }
+
+    uint32_t client = rpc.client;
+    _rpcFree.push_back(id);
+    if (now < _endTime) {
+        startRpc(client);
+    }
+}
+
+void
+FlowGenerator::reportRpcs()
+{
+    static const char *classes[] = {"10KB", "100KB", "1MB", "10MB", "max"};
+
+    for (uint32_t i = 0; i < _rpcLatency.size(); i++) {
+        vector<double> &l = _rpcLatency[i];
+        if (l.empty()) {
+            continue;
+        }
+        sort(l.begin(), l.end());
+
+        double mean = 0;
+        for (double lat : l) {
+            mean += lat;
+        }
+
+        size_t n = l.size();
+        cout << setprecision(6) << "RpcStats " << _prefix << "upto " << classes[i]
+             << " rpcs " << n << " mean " << mean / n << " p50 " << l[n / 2]
+             << " p99 " << l[min(n - 1, n * 99 / 100)]
+             << " p999 " << l[min(n - 1, n * 999 / 1000)] << endl;
+    }
+
+    cout << "Open RPCs: " << _rpcs.size() - _rpcFree.size() << endl;
 }
 
 void
 FlowGenerator::finishFlow(uint32_t flow_id)
 {
-    if (_liveFlows.erase(flow_id) == 0) {
+    auto live = _liveFlows.find(flow_id);
+    if (live == _liveFlows.end()) {
         return;
     }
+    if (_schedule != NULL) {
+        _schedule->flowFinished(live->second->_start_time, EventList::Get().now());
+    }
+    if (_monitor != NULL) {
+        _monitor->flowFinished(live->second->_start_time, EventList::Get().now());
+    }
+    _liveFlows.erase(live);
+
+    auto job = _coflows.find(flow_id);
+    if (job != _coflows.end()) {
+        Coflow *c = job->second;
+        _coflows.erase(job);
+
+        if (--c->remaining == 0) {
+            simtime_picosec now = EventList::Get().now();
+            cout << setprecision(6) << "Coflow " << _prefix << "job" << c->id
+                 << " flows " << c->nFlows << " size " << c->bytes
+                 << " start " << lround(timeAsUs(c->start)) << " end " << lround(timeAsUs(now))
+                 << " jct " << timeAsUs(now - c->start) << endl;
+            delete c;
+        }
+    }
 
     if (_replaceFlow) {
         uint64_t flowSize = _workload.generateFlowSize();
@@ -220,15 +805,41 @@ FlowGenerator::finishFlow(uint32_t flow_id)
     }
 }
 
+void
+FlowGenerator::endOfRun()
+{
+    if (_rpcOutstanding > 0) {
+        reportRpcs();
+    }
+    dumpLiveFlows();
+}
+
+void
+FlowGenerator::refreshRoutes(DataSource &src)
+{
+    const route_t *routeFwd = NULL, *routeRev = NULL;
+    uint32_t srcNode = src._node_id, dstNode = src._sink->_node_id;
+    _routeGen(routeFwd, routeRev, srcNode, dstNode);
+    src.setRoutes(*routeFwd, *routeRev);
+}
+
 void
 FlowGenerator::dumpLiveFlows()
 {
-    cout << endl << "Live Flows: " << _liveFlows.size() << endl;
+    cout << endl << "Live Flows: " << _liveFlows.size() + _pooledFlows.size() << endl;
     for (auto flow : _liveFlows) {
         DataSource *src = flow.second;
         src->printStatus();
     }
 
+    if (_tm != NULL && _tm->isJob()) {
+        unordered_set<Coflow*> jobs;
+        for (auto job : _coflows) {
+            jobs.insert(job.second);
+        }
+        cout << "Live Coflows: " << jobs.size() << endl;
+    }
+
     // TODO: temp hack, remove later.
     /*
        uint64_t cumul = 0;
@@ -246,3 +857,51 @@ FlowGenerator::dumpLiveFlows()
        }
        */
 }
+
+
+HostArrivals::HostArrivals(FlowGenerator &gen,
+                           uint32_t host,
+                           uint32_t partition,
+                           double meanGap)
+    : _gen(gen),
+    _host(host),
+    _partition(partition),
+    _meanGap(meanGap),
+    _next(0)
+{}
+
+void
+HostArrivals::start(simtime_picosec startTime)
+{
+    _next = startTime;
+    scheduleNext();
+}
+
+void
+HostArrivals::pacedSend()
+{
+    _gen.createHostArrival(_host, _partition);
+    scheduleNext();
+}
+
+void
+HostArrivals::scheduleNext()
+{
+    // Under a load schedule, draw at its peak rate and keep each arrival
+    // with probability load / peak (thinning).
+    LoadSchedule *schedule = _gen._schedule;
+    double peak = (schedule != NULL) ? schedule->peak() / _gen._baseLoad : 1;
+    if (peak <= 0) {
+        return;
+    }
+
+    // Step from the ideal time, not the slot the wheel released us in.
+    do {
+        _next += llround(-log(_gen.uniform(_partition)) * _meanGap / peak);
+    } while (schedule != NULL && _next < _gen._endTime &&
+            _gen.uniform(_partition) * peak > schedule->load(_next) / _gen._baseLoad);
+
+    if (_next < _gen._endTime) {
+        _gen._partitions[_partition].wheel->schedule(*this, _next);
+    }
+}
@@ -11,20 +11,58 @@
 #include "tcp.h"
 #include "packetpair.h"
 #include "timely.h"
+#include "homa.h"
+#include "hpcc.h"
+#include "hostnic.h"
 #include "workloads.h"
+#include "flowtrace.h"
+#include "traffic.h"
+#include "loadschedule.h"
+#include "convergence.h"
 #include "prof.h"
 
 #include <deque>
 #include <functional>
+#include <random>
+#include <unordered_set>
 
-/* Route generator function. */
-typedef std::function<void(route_t *&, route_t *&, uint32_t &, uint32_t &)> route_gen_t;
+/* Route generator function. Returns shared hop lists (without the endpoints)
+ * that must stay valid for as long as flows use them. */
+typedef std::function<void(const route_t *&, const route_t *&, uint32_t &, uint32_t &)> route_gen_t;
+
+class FlowGenerator;
+
+/*
+ * Poisson flow arrivals at one host, on the arrival wheel of the host's
+ * partition (see FlowGenerator::setHostArrivals).
+ */
+class HostArrivals : public PacedSource
+{
+    public:
+        HostArrivals(FlowGenerator &gen, uint32_t host, uint32_t partition, double meanGap);
+
+        // Schedules the first arrival after startTime.
+        void start(simtime_picosec startTime);
+        void pacedSend();
+
+    private:
+        // Draws the next arrival and puts it on the wheel, unless it is
+        // past the generator's end.
+        void scheduleNext();
+
+        FlowGenerator &_gen;
+        uint32_t _host;
+        uint32_t _partition;
+        double _meanGap;
+        simtime_picosec _next;        // Ideal time of the next arrival.
+};
 
 class FlowGenerator : public EventSource
 {
+    friend class HostArrivals;
     public:
         FlowGenerator(DataSource::EndHost endhost, route_gen_t rg, linkspeed_bps flowRate,
-                uint32_t avgFlowSize, Workloads::FlowDist flowSizeDist);
+                uint32_t avgFlowSize, const std::string &flowSizeDist);
         void doNextEvent();
 
         /* Set flow generation start time. */
@@ -33,32 +71,168 @@ class FlowGenerator : public EventSource
         /* Creates a separate endhost queue for every flow. */
         void setEndhostQueue(linkspeed_bps qRate, uint64_t qBuffer);
 
+        /* Sends every flow through the NIC of its source host instead, one
+         * shared queue per host with the given scheduler across flows. */
+        void setHostNic(linkspeed_bps qRate, uint64_t qBuffer, HostNic::Scheduler sched);
+
         /* Fixes max flows in the systems and replaces them when finished. */
         void setReplaceFlow(uint32_t maxFlows, double offRatio);
 
         /* Appends a prefix to flow names to differetiate from other generators. */
         void setPrefix(std::string prefix);
+        inline const std::string& prefix() const {return _prefix;}
+
+        /* Makes TCP flows tolerate reordering (e.g. under per-packet load balancing). */
+        void setReorderTolerance(bool enable);
 
-        /* Flow arrival using a trace instead of dynamic generation during simulation. */
+        /* Makes TCP sinks ACK every segs segments, or after timeout. */
+        void setDelayedAck(uint32_t segs, simtime_picosec timeout);
+
+        /* Makes TCP flows recover from losses with SACK and RACK-TLP. */
+        void setSack(bool enable);
+
+        /* Paces TCP flows in bursts of quantum segments, 0 disables pacing. */
+        void setPacing(uint32_t quantum);
+
+        /* Flow arrival using a trace instead of dynamic generation during simulation.
+         * The trace is streamed (see FlowTrace), and its hosts are used when set. */
         void setTrace(std::string filename);
 
+        /* Chooses the hosts of each arrival with a traffic matrix instead of
+         * the route generator. Arrivals of job patterns (incast, all-to-all)
+         * start several flows, the rate is kept by spacing arrivals out, and
+         * each job reports its completion time when its last flow ends. */
+        void setTrafficMatrix(TrafficMatrix *tm);
+
+        /* Varies the arrival rate over time with a load schedule; the rate
+         * given to the constructor is the one at load base. */
+        void setLoadSchedule(LoadSchedule *schedule, double base);
+
+        /* Replaces the single arrival process with one per host, each with an
+         * equal share of the rate. A flow goes to another host of the same
+         * rack with probability localRatio (< 0 for the share of such hosts,
+         * as with uniform destinations) and to another rack otherwise.
+         *
+         * Hosts are split into nPartitions groups of whole racks. Each group
+         * has an arrival wheel (a HostPacer) and a random stream of its own,
+         * for arrival times, destinations and sizes, so groups generate
+         * independently of each other. A load schedule scales every host's
+         * rate; a trace, traffic matrix or RPCs can't be combined with it.
+         * Call before setTimeLimits(). */
+        void setHostArrivals(uint32_t nHosts, uint32_t hostsPerRack, double localRatio,
+                uint32_t nPartitions);
+
+        /* Scales the arrival rate of the hosts of some racks, given as a list
+         * of rack:scale such as "0:2,5:0.5". */
+        void setRackLoads(const std::string &list);
+
+        /* Draws arrivals ahead in blocks of blockSize, from a random stream
+         * of the generator's own: arrival times, sizes, start jitter and,
+         * given the number of hosts, endpoints (the route generator still
+         * picks the path when the flow starts). Each arrival then only
+         * creates its pooled flow objects. Plain Poisson arrivals only; call
+         * before setTimeLimits(). */
+        void setBatchArrivals(uint32_t blockSize, uint32_t nHosts);
+
+        /* Replaces flow arrivals with closed-loop RPCs: every host is a client
+         * that keeps outstanding RPCs open, each a request of requestSize
+         * bytes to a random server and a response sized by the flow size
+         * distribution, and issues the next one as soon as a response is
+         * in. Requests and responses are messages on persistent TCP
+         * connections (see TcpSrc::setPersistent), one each way per host
+         * pair, set up on first use. RPC latencies are reported at the end
+         * time as "RpcStats" lines per response size class. Call before
+         * setTimeLimits(). */
+        void setRpc(uint32_t nHosts, uint32_t outstanding, uint64_t requestSize);
+
+        /* Carries the flows between each pair of hosts as messages on one
+         * persistent TCP connection, set up with the pair's first flow, so
+         * later flows start with the cwnd, RTT estimates and DCTCP alpha
+         * the connection has and create no objects. A flow starts when it
+         * arrives (without start jitter) and ends, like a one-off flow, once
+         * the ack for all of it is back at the source. A connection takes a
+         * newly generated route whenever it is idle as a flow arrives. Not
+         * with setReplaceFlow(); flows of job patterns stay one-off, as
+         * their coflows are tracked by flow. */
+        void setConnectionPool(bool enable);
+
+        /* Reports the FCT of every flow (or latency of every RPC) to a
+         * convergence monitor, which may end the run early. The live flows
+         * and RPC statistics are then printed when it stops the run. */
+        void setMonitor(ConvergenceMonitor *monitor);
+
         /* Used by Source to notify the Generator of flow finishing, which can then
          * (optionally) generate a new flow. */
         void finishFlow(uint32_t flow_id);
+
+        /* Routes a running flow again between its hosts, with the route
+         * generator's current choice (see DataSource::refreshRoutes()). */
+        void refreshRoutes(DataSource &src);
         void dumpLiveFlows();
 
     private:
-        // Creates a flow in the simulation.
-        void createFlow(uint64_t flowSize, simtime_picosec startTime);
+        /* Flows that started together, done when the last of them is. */
+        struct Coflow {
+            uint32_t id;
+            uint32_t nFlows;
+            uint32_t remaining;
+            uint64_t bytes;
+            simtime_picosec start;
+        };
+
+        // Starts the flows of one arrival of the traffic matrix.
+        void createArrival();
+
+        // Per-host arrivals: a uniform draw in (0,1] from a partition's
+        // stream, and the flow of an arrival at host.
+        double uniform(uint32_t partition);
+        void createHostArrival(uint32_t host, uint32_t partition);
+
+        // Uniform in (0,1] from a raw 64 bit draw.
+        static inline double unit(uint64_t r) {return ((r >> 11) + 1) / 9007199254740992.0;}
+
+        // Draws the next block of arrivals, the first one after last.
+        void refillBatch(simtime_picosec last);
+
+        // Creates a flow in the simulation, between the given hosts if the
+        // route generator takes them, and returns its source (NULL if it is
+        // pooled). Start jitter is added unless the caller has drawn it
+        // already.
+        DataSource* createFlow(uint64_t flowSize, simtime_picosec startTime,
+                uint32_t srcHost = TRACE_ANY_HOST, uint32_t dstHost = TRACE_ANY_HOST,
+                bool jitter = true);
 
         // Returns a flow size according to some distribution.
         uint64_t generateFlowSize();
 
+        // Creates a persistent TCP connection between two hosts, started at
+        // startTime, with the generator's endhost settings (see
+        // TcpSrc::setPersistent for onAck).
+        TcpSrc* createConnection(uint32_t srcHost, uint32_t dstHost, simtime_picosec startTime,
+                TcpSrc::MessageHandler handler);
+        TcpSrc* createConnection(const route_t *routeFwd, const route_t *routeRev,
+                uint32_t srcNode, uint32_t dstNode, simtime_picosec startTime,
+                TcpSrc::MessageHandler handler, bool onAck = false);
+
+        // Pooled flows: sends one on the connection of its hosts, and
+        // reports it once its last byte is acked, as a one-off flow is.
+        void sendPooled(uint64_t flowSize, uint32_t srcHost, uint32_t dstHost);
+        void pooledFlowDone(uint64_t flow);
+
+        // RPCs: issues one from client, and moves one on as its request
+        // and then its response is delivered.
+        void startRpc(uint32_t client);
+        void rpcRequestDone(uint64_t rpc);
+        void rpcResponseDone(uint64_t rpc);
+        void reportRpcs();
+
+        // Prints the reports due at the end time.
+        void endOfRun();
+
         std::string _prefix;          // Optional prefix for flows.
         DataSource::EndHost _endhost; // Type of endhost.
         route_gen_t _routeGen;        // Function to generate a route.
         linkspeed_bps _flowRate;      // Target flow rate in bytes/sec.
-        uint32_t _flowSizeDist;       // Distribution of flow size [0/1/2] - Uniform/Exp/Pareto.
         uint32_t _flowsGenerated;     // Total number of flow generated.
         simtime_picosec _endTime;     // When to stop generating flows and dump live ones.
         Workloads _workload;          // Type of workload and characteristics.
@@ -67,6 +241,21 @@ class FlowGenerator : public EventSource
         bool _endhostQ;
         linkspeed_bps _endhostQrate;
         uint64_t _endhostQbuffer;
+        bool _hostNic;
+        HostNic::Scheduler _nicSched;
+
+        // Delay fast retransmit by a reordering window in TCP flows.
+        bool _reorderTolerant;
+
+        // Delayed ACK configuration of TCP sinks.
+        uint32_t _delackSegs;
+        simtime_picosec _delackTimeout;
+
+        // SACK loss recovery in TCP flows.
+        bool _sack;
+
+        // Pacing burst of TCP flows in segments, 0 if not paced.
+        uint32_t _paceQuantum;
 
         // Flow replacement configuration.
         bool _useTrace;               // Use a trace for flow generations.
@@ -75,17 +264,92 @@ class FlowGenerator : public EventSource
         uint32_t _concurrentFlows;    // Number of concurrent flows.
         simtime_picosec _avgOffTime;  // Sleep duration as fraction of avgFCT.
 
-        // Trace of flow arrivals, if using trace generation. (arrival_time, size)
-        std::deque<std::pair<simtime_picosec, uint64_t> > _flowTrace;
+        // Trace of flow arrivals, if using trace generation.
+        FlowTrace _flowTrace;
 
         // List of live flows in the system.
         std::unordered_map<uint32_t,DataSource*> _liveFlows;
 
+        // Traffic matrix, if any, and the coflow of each live flow of a job.
+        TrafficMatrix *_tm;
+        std::vector<std::pair<uint32_t, uint32_t> > _arrival;
+        std::unordered_map<uint32_t, Coflow*> _coflows;
+        uint32_t _coflowsGenerated;
+
+        // Load schedule, if any, and the load the flow rate is given for.
+        LoadSchedule *_schedule;
+        double _baseLoad;
+
+        // Convergence monitor, if any.
+        ConvergenceMonitor *_monitor;
+
+        // Per-host arrival processes, and the wheel and stream of each partition.
+        struct ArrivalPartition {
+            HostPacer *wheel;
+            std::mt19937_64 rng;
+        };
+
+        std::vector<HostArrivals*> _hostArrivals;
+        std::vector<ArrivalPartition> _partitions;
+        std::vector<double> _rackLoad;
+        uint32_t _nHosts;
+        uint32_t _hostsPerRack;
+        double _localRatio;
+
+        // Arrivals drawn ahead, and the next one due.
+        struct FlowDesc {
+            simtime_picosec arrival;
+            simtime_picosec jitter;
+            uint64_t size;
+            uint32_t src;
+            uint32_t dst;
+        };
+
+        std::vector<FlowDesc> _batch;
+        std::vector<uint64_t> _draws;
+        size_t _batchNext;
+        uint32_t _batchSize;
+        uint32_t _batchHosts;
+        std::mt19937_64 _batchRng;
+
+        // Open RPCs, with the free slots among them, and the connections
+        // of each client and server pair.
+        struct Rpc {
+            uint32_t client;
+            uint32_t server;
+            uint64_t size;
+            simtime_picosec start;
+        };
+
+        struct RpcChannel {
+            TcpSrc *request;
+            TcpSrc *response;
+        };
+
+        std::vector<Rpc> _rpcs;
+        std::vector<uint32_t> _rpcFree;
+        std::unordered_map<uint64_t, RpcChannel> _rpcChannels;
+        uint32_t _rpcHosts;
+        uint32_t _rpcOutstanding;
+        uint64_t _rpcRequest;
+
+        // RPC latencies in microseconds, by response size class.
+        std::vector<std::vector<double> > _rpcLatency;
+
+        // Connection of each source and destination host pair, and the
+        // pooled flows not yet acked, by flow number.
+        struct PooledFlow {
+            uint64_t size;
+            simtime_picosec start;
+            TcpSrc *conn;
+        };
+
+        bool _pool;
+        std::unordered_map<uint64_t, TcpSrc*> _connections;
+        std::unordered_map<uint64_t, PooledFlow> _pooledFlows;
+
         // Average flow inter-arrival time, computed using arguments.
         simtime_picosec _avgFlowArrivalTime;
-
-        // Custom flow size distribution.
-        std::map<double,uint64_t> _flowSizeCDF;
 };
 
 #endif /* FLOW_GENERATOR_H */
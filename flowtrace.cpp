@@ -0,0 +1,177 @@
+/*
+ * Flow trace
+ */
+#include "flowtrace.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Marks a binary flow trace, and its layout version.
+static const char TRACE_MAGIC[8] = {'h', 't', 's', 't', 'r', 'c', '0', '2'};
+
+struct TraceHeader {
+    char magic[8];
+    uint64_t count;  // Number of records.
+};
+
+FlowTrace::FlowTrace()
+    : _map(NULL),
+    _mapSize(0),
+    _records(NULL),
+    _count(0),
+    _next(0)
+{}
+
+FlowTrace::~FlowTrace()
+{
+    if (_map != NULL) {
+        munmap(_map, _mapSize);
+    }
+}
+
+bool
+FlowTrace::isBinary(const string &filename)
+{
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    TraceHeader h;
+    bool binary = fread(&h, sizeof(h), 1, fp) == 1 &&
+        memcmp(h.magic, TRACE_MAGIC, sizeof(h.magic)) == 0;
+    fclose(fp);
+    return binary;
+}
+
+void
+FlowTrace::open(const string &filename)
+{
+    string binary = filename;
+
+    if (!isBinary(filename)) {
+        // Convert a text trace, unless it was already and hasn't changed.
+        binary = filename + ".bin";
+        struct stat txt, bin;
+        if (stat(filename.c_str(), &txt) != 0) {
+            fprintf(stderr, "Error opening trace file: %s\n", filename.c_str());
+            exit(1);
+        }
+        if (stat(binary.c_str(), &bin) != 0 || bin.st_mtime < txt.st_mtime ||
+                !isBinary(binary)) {
+            convert(filename, binary);
+        }
+    }
+
+    int fd = ::open(binary.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Error opening trace file: %s\n", binary.c_str());
+        exit(1);
+    }
+
+    _mapSize = st.st_size;
+    _map = mmap(NULL, _mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (_map == MAP_FAILED) {
+        fprintf(stderr, "Error mapping trace file: %s\n", binary.c_str());
+        exit(1);
+    }
+
+    const TraceHeader *h = (const TraceHeader*)_map;
+    if (_mapSize < sizeof(TraceHeader) ||
+            _mapSize - sizeof(TraceHeader) < h->count * sizeof(TraceRecord)) {
+        fprintf(stderr, "Truncated trace file: %s\n", binary.c_str());
+        exit(1);
+    }
+
+    _records = (const TraceRecord*)(h + 1);
+    _count = h->count;
+    _next = 0;
+
+    madvise(_map, _mapSize, MADV_SEQUENTIAL);
+    readAhead();
+}
+
+void
+FlowTrace::advance()
+{
+    _next++;
+    if (_next % WINDOW == 0) {
+        readAhead();
+    }
+}
+
+void
+FlowTrace::readAhead()
+{
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t window = _next / WINDOW;
+    uintptr_t base = (uintptr_t)_map;
+    uintptr_t end = base + _mapSize;
+
+    uintptr_t ahead = (uintptr_t)(_records + (window + 1) * WINDOW) & ~(page - 1);
+    if (ahead < end) {
+        madvise((void*)ahead, min((uintptr_t)(WINDOW * sizeof(TraceRecord)) + page, end - ahead),
+                MADV_WILLNEED);
+    }
+
+    if (window >= 1) {
+        uintptr_t behind = (uintptr_t)(_records + (window - 1) * WINDOW) & ~(page - 1);
+        uintptr_t last = (uintptr_t)(_records + window * WINDOW) & ~(page - 1);
+        if (behind > base && last > behind) {
+            madvise((void*)behind, last - behind, MADV_DONTNEED);
+        }
+    }
+}
+
+void
+FlowTrace::convert(const string &text,
+                   const string &binary)
+{
+    FILE *in = fopen(text.c_str(), "r");
+    if (in == NULL) {
+        fprintf(stderr, "Error opening trace file: %s\n", text.c_str());
+        exit(1);
+    }
+
+    FILE *out = fopen(binary.c_str(), "wb");
+    if (out == NULL) {
+        fprintf(stderr, "Error writing trace file: %s\n", binary.c_str());
+        exit(1);
+    }
+
+    // The count is written again once known.
+    TraceHeader h;
+    memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+    h.count = 0;
+    fwrite(&h, sizeof(h), 1, out);
+
+    uint32_t fid;
+    uint64_t fsize;
+    uint64_t fstart;
+    uint64_t prev = 0;
+
+    /* Assumes the file is sorted by flow arrival. */
+    while (fscanf(in, "flow-%u %lu %*s %lu %*s %*s ", &fid, &fstart, &fsize) == 3) {
+        if (fstart < prev) {
+            fprintf(stderr, "Trace %s: flow-%u out of order\n", text.c_str(), fid);
+            exit(1);
+        }
+
+        TraceRecord r = {fsize, (fstart - prev) * 1000, TRACE_ANY_HOST, TRACE_ANY_HOST, 0};
+        prev = fstart;
+        fwrite(&r, sizeof(r), 1, out);
+        h.count++;
+    }
+
+    fclose(in);
+
+    fseek(out, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, out);
+    fclose(out);
+}
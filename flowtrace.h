@@ -0,0 +1,76 @@
+/*
+ * Flow trace header
+ */
+#ifndef FLOWTRACE_H
+#define FLOWTRACE_H
+
+#include "htsim.h"
+
+#include <string>
+
+// Host of a trace record that leaves the choice to the route generator.
+#define TRACE_ANY_HOST UINT32_MAX
+
+/*
+ * One flow arrival in a binary trace. Records follow a header and are
+ * stored in arrival order, each timed from the one before it.
+ */
+struct TraceRecord {
+    uint64_t size;   // Flow size in bytes.
+    uint64_t delta;  // Nanoseconds since the previous arrival (or time 0).
+    uint32_t src;    // Source and destination hosts, or TRACE_ANY_HOST.
+    uint32_t dst;
+    uint32_t cls;    // Traffic class, free for the experiment to use.
+};
+
+/*
+ * Reads a binary flow trace as a stream.
+ *
+ * The file is mapped rather than read, and records are decoded one at a
+ * time as arrivals are due, so replay starts at once and memory does not
+ * grow with the trace. The cursor asks the kernel for the window of
+ * records ahead of it and drops the window behind it, so only a couple of
+ * windows of a long trace are resident at any time.
+ *
+ * Text traces (lines of "flow-<id> <start us> <x> <size> <x> <x>", without
+ * hosts) are converted once to "<name>.bin" with convert(), which also
+ * streams, and open() does that on its own when given a text trace.
+ */
+class FlowTrace
+{
+    public:
+        FlowTrace();
+        ~FlowTrace();
+
+        // Maps a binary trace, converting a text one first. Exits on error.
+        void open(const std::string &filename);
+
+        // Whether there is a record at the cursor, and the record.
+        inline bool valid() const {return _next < _count;}
+        inline const TraceRecord& current() const {return _records[_next];}
+
+        // Moves the cursor to the next record.
+        void advance();
+
+        // Writes the binary form of a text trace, in constant memory.
+        static void convert(const std::string &text, const std::string &binary);
+
+    private:
+        // Records per read-ahead window.
+        static const uint64_t WINDOW = 1 << 16;
+
+        // At a window boundary, reads the next window ahead and lets go of
+        // the one before the current window.
+        void readAhead();
+
+        // Whether the file starts with a binary trace header.
+        static bool isBinary(const std::string &filename);
+
+        void *_map;
+        size_t _mapSize;
+        const TraceRecord *_records;
+        uint64_t _count;
+        uint64_t _next;
+};
+
+#endif /* FLOWTRACE_H */
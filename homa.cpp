@@ -0,0 +1,245 @@
+/*
+ * Homa
+ */
+#include "homa.h"
+#include "flow-generator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+vector<HomaReceiver*> HomaReceiver::_receivers;
+
+HomaSrc::HomaSrc(TrafficLogger *pktlogger,
+                 uint64_t flowsize)
+    : DataSource(pktlogger, flowsize, 0),
+      _state(IDLE),
+      _granted(0),
+      _sched_priority(HOMA_UNSCHED_LEVELS),
+      _rtt(0),
+      _rto(timeFromUs(MIN_RTO_US)),
+      _rto_timeout(0)
+{
+    // Constructor
+}
+
+void
+HomaSrc::printStatus()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    cout << setprecision(6) << "LiveFlow " << str() << " size " << _flowsize
+         << " start " << lround(timeAsUs(_start_time)) << " end " << _last_acked
+         << " sent " << _highest_sent << " " << _packets_sent - _highest_sent
+         << " granted " << _granted
+         << " rate " << _last_acked * 8000.0 / (current_ts - _start_time) << endl;
+}
+
+void
+HomaSrc::doNextEvent()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    _wakeup_at = 0;
+
+    // New message, send the unscheduled part.
+    if (_state == IDLE) {
+        _state = ACTIVE;
+        _granted = min(_flowsize, (uint64_t)HOMA_RTT_BYTES);
+        sendPackets();
+    }
+
+    // Cleanup the finished flow.
+    else if (_state == FINISH) {
+        if (_flow._nPackets == 0) {
+            release();
+            return;
+        }
+
+        // Woken again when the last packet of the flow is gone.
+        _flow.setWaiter(this);
+        return;
+    }
+
+    // No progress for a while: resend everything not acked.
+    else if (_rto_timeout != 0 && current_ts >= _rto_timeout) {
+        refreshRoutes();
+        _highest_sent = _last_acked;
+        _rto_timeout = 0;
+        sendPackets();
+    }
+
+    _wakeup_at = current_ts + _rto;
+    EventList::Get().sourceIsPending(*this, _wakeup_at);
+}
+
+void
+HomaSrc::receivePacket(Packet &pkt)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    DataAck *p = (DataAck*)(&pkt);
+    DataAck::seq_t seqno = p->ackno();
+    DataAck::seq_t grant = p->grant();
+    uint32_t priority = p->grantPriority();
+    simtime_picosec ts = p->ts();
+
+    pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
+    p->free();
+
+    if (_state == FINISH) {
+        return;
+    }
+
+    if (seqno >= _flowsize) {
+        if (_flowgen != NULL) {
+            _flowgen->finishFlow(id);
+        }
+        _state = FINISH;
+
+        cout << setprecision(6) << "Flow " << str() << " " << id << " size " << _flowsize
+             << " start " << lround(timeAsUs(_start_time)) << " end " << lround(timeAsUs(current_ts))
+             << " fct " << timeAsUs(current_ts - _start_time)
+             << " sent " << _highest_sent << " " << _packets_sent - _highest_sent
+             << " tput " << _flowsize * 8000.0 / (current_ts - _start_time)
+             << " rtt " << timeAsUs(_rtt) << endl;
+
+        if (_flow._nPackets == 0) {
+            release();
+        }
+        return;
+    }
+
+    // Grants sent for other flows' data don't echo a timestamp.
+    if (ts != 0) {
+        simtime_picosec m = current_ts - ts;
+        _rtt = (_rtt == 0) ? m : (_rtt * 7 + m) / 8;
+        _rto = max(4 * _rtt, timeFromUs(MIN_RTO_US));
+    }
+
+    if (seqno > _last_acked) {
+        _last_acked = seqno;
+        _rto_timeout = (_last_acked < _highest_sent) ? current_ts + _rto : 0;
+    }
+
+    if (grant > _granted) {
+        _granted = grant;
+    }
+
+    // The receiver reranks its flows as others come and go, so the level
+    // can move without a new grant.
+    _sched_priority = priority;
+
+    sendPackets();
+}
+
+void
+HomaSrc::sendPackets()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    uint32_t unsched = unschedPriority();
+
+    while (_highest_sent < _granted) {
+        DataPacket *p = DataPacket::newpkt(_flow, _route_fwd, _highest_sent + 1, MSS_BYTES);
+        p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
+        p->set_ts(current_ts);
+        p->setPriority(_highest_sent < HOMA_RTT_BYTES ? unsched : _sched_priority);
+
+        _highest_sent += MSS_BYTES;
+        _packets_sent += MSS_BYTES;
+        p->sendOn();
+
+        if (_rto_timeout == 0) {
+            _rto_timeout = current_ts + _rto;
+        }
+    }
+}
+
+uint32_t
+HomaSrc::unschedPriority() const
+{
+    // Each level up covers messages 4x larger.
+    uint64_t limit = HOMA_RTT_BYTES;
+    uint32_t level = 0;
+    while (level < HOMA_UNSCHED_LEVELS - 1 && _flowsize > limit) {
+        limit *= 4;
+        level++;
+    }
+    return level;
+}
+
+
+HomaSink::HomaSink()
+    : DataSink(),
+    _granted(HOMA_RTT_BYTES),
+    _priority(HOMA_UNSCHED_LEVELS),
+    _active(false)
+{}
+
+void
+HomaSink::receivePacket(Packet &pkt)
+{
+    DataPacket *p = (DataPacket*)(&pkt);
+    simtime_picosec ts = p->ts();
+    processDataPacket(*p);
+
+    pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
+    p->free();
+
+    HomaReceiver::forHost(_node_id).schedule(*this);
+    sendGrant(ts);
+}
+
+void
+HomaSink::sendGrant(simtime_picosec ts)
+{
+    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, 1, cumulative_ack());
+    ack->flow().logTraffic(*ack, *this, TrafficLogger::PKT_CREATESEND);
+    ack->set_ts(ts);
+    ack->setGrant(_granted, _priority);
+    ack->sendOn();
+}
+
+
+HomaReceiver&
+HomaReceiver::forHost(uint32_t host)
+{
+    if (host >= _receivers.size()) {
+        _receivers.resize(host + 1, NULL);
+    }
+    if (_receivers[host] == NULL) {
+        _receivers[host] = new HomaReceiver();
+    }
+    return *_receivers[host];
+}
+
+void
+HomaReceiver::schedule(HomaSink &sink)
+{
+    // Track the flow until all of it has arrived. Flows sent unscheduled
+    // in full need no grants and must not take the top SRPT ranks.
+    if (!sink._active && sink.remaining() > 0 && sink._src->_flowsize > HOMA_RTT_BYTES) {
+        sink._active = true;
+        _incoming.push_back(&sink);
+    } else if (sink._active && sink.remaining() == 0) {
+        sink._active = false;
+        _incoming.erase(find(_incoming.begin(), _incoming.end(), &sink));
+    }
+
+    // SRPT: grant the flows with the least left to receive.
+    uint32_t n = min((uint32_t)_incoming.size(), (uint32_t)HOMA_OVERCOMMIT);
+    partial_sort(_incoming.begin(), _incoming.begin() + n, _incoming.end(),
+            [](HomaSink *a, HomaSink *b) {return a->remaining() < b->remaining();});
+
+    for (uint32_t rank = 0; rank < n; rank++) {
+        HomaSink *s = _incoming[rank];
+        uint64_t grant = min((uint64_t)s->_src->_flowsize, s->cumulative_ack() + HOMA_RTT_BYTES);
+        uint32_t priority = HOMA_UNSCHED_LEVELS + min(rank, (uint32_t)HOMA_SCHED_LEVELS - 1);
+
+        if (grant > s->_granted || priority != s->_priority) {
+            s->_granted = max(grant, s->_granted);
+            s->_priority = priority;
+            if (s != &sink) {
+                s->sendGrant(0);
+            }
+        }
+    }
+}
@@ -0,0 +1,114 @@
+/*
+ * Homa header
+ */
+#ifndef HOMA_H
+#define HOMA_H
+
+#include "eventlist.h"
+#include "datasource.h"
+
+#include <vector>
+
+// Bytes a sender may send unscheduled, and a granted flow may have
+// outstanding: about one BDP of a 10Gbps host link.
+#define HOMA_RTT_BYTES (10 * MSS_BYTES)
+
+// Priority levels, 0 the highest as in PriorityQueue. Unscheduled data
+// uses the top levels by message size, scheduled data the rest by the
+// receiver's SRPT rank. Grants and acks go at level 0.
+#define HOMA_UNSCHED_LEVELS 4
+#define HOMA_SCHED_LEVELS 4
+
+// Flows a receiver grants to at once (Homa's degree of overcommitment).
+#define HOMA_OVERCOMMIT 2
+
+class HomaSink;
+class FlowGenerator;
+
+/*
+ * Receiver-driven transport in the style of Homa and pHost.
+ *
+ * A sender starts by blasting its first HOMA_RTT_BYTES unscheduled, at a
+ * priority set by the message size. The rest is only sent as the receiver
+ * grants it. Each receiving host runs SRPT over its incoming flows (see
+ * HomaReceiver): the few with the least left to receive are granted one
+ * RTT of data past what has arrived, each at its own priority level.
+ *
+ * Priorities only take effect through PriorityQueue (--queue=pq). Lost
+ * packets are resent go-back-N style after a timeout without progress.
+ */
+class HomaSrc : public DataSource, public Pooled<HomaSrc>
+{
+    friend class HomaSink;
+    public:
+        HomaSrc(TrafficLogger *pktlogger, uint64_t flowsize = 0);
+
+        void printStatus();
+        void doNextEvent();
+        void receivePacket(Packet &pkt);
+
+        // Flow status.
+        enum FlowStatus {
+            IDLE,
+            ACTIVE,
+            FINISH
+        } _state;
+
+        uint64_t _granted;           // Bytes the receiver has allowed.
+        uint32_t _sched_priority;    // Level of granted packets.
+
+        simtime_picosec _rtt, _rto;
+        simtime_picosec _rto_timeout;
+
+    private:
+        void sendPackets();
+
+        // Level of unscheduled packets, higher for shorter messages.
+        uint32_t unschedPriority() const;
+};
+
+class HomaSink : public DataSink, public Pooled<HomaSink>
+{
+    friend class HomaSrc;
+    friend class HomaReceiver;
+    public:
+        HomaSink();
+        void receivePacket(Packet &pkt);
+
+    private:
+        // Bytes not yet received.
+        inline uint64_t remaining() {
+            return _src->_flowsize - std::min(cumulative_ack(), (uint64_t)_src->_flowsize);
+        }
+
+        // Sends the cumulative ack with the current grant.
+        void sendGrant(simtime_picosec ts);
+
+        uint64_t _granted;
+        uint32_t _priority;
+        bool _active;                // Among its host's incoming flows.
+};
+
+/*
+ * Grant scheduler of one receiving host, shared by all its HomaSinks.
+ */
+class HomaReceiver
+{
+    public:
+        // The receiver of a host, created on first use.
+        static HomaReceiver& forHost(uint32_t host);
+
+        // Updates grants after data arrived for sink, and sends a grant to
+        // every other flow whose grant moved.
+        void schedule(HomaSink &sink);
+
+    private:
+        HomaReceiver() {}
+
+        // Flows with scheduled bytes still to arrive.
+        std::vector<HomaSink*> _incoming;
+
+        static std::vector<HomaReceiver*> _receivers;
+};
+
+#endif /* HOMA_H */
@@ -0,0 +1,135 @@
+/*
+ * Host NIC
+ */
+#include "hostnic.h"
+#include "datapacket.h"
+
+using namespace std;
+
+vector<HostNic*> HostNic::_nics;
+
+HostNic::HostNic(linkspeed_bps bitrate,
+                 mem_b maxsize,
+                 Scheduler sched)
+    : Queue(bitrate, maxsize, NULL),
+    _sched(sched),
+    _arrivals(0),
+    _round(0),
+    _currentPkt(NULL)
+{
+    setName("nic");
+}
+
+HostNic&
+HostNic::forHost(uint32_t host,
+                 linkspeed_bps bitrate,
+                 mem_b maxsize,
+                 Scheduler sched)
+{
+    if (host >= _nics.size()) {
+        _nics.resize(host + 1, NULL);
+    }
+    if (_nics[host] == NULL) {
+        _nics[host] = new HostNic(bitrate, maxsize, sched);
+    }
+    return *_nics[host];
+}
+
+uint64_t
+HostNic::schedKey(Packet &pkt)
+{
+    if (_sched == FIFO) {
+        return 0;
+    }
+
+    auto it = _flows.find(pkt.flow().id);
+    if (it != _flows.end()) {
+        // RR: one round past the flow's previous packet, and not before
+        // the round in service. SRPT: the key the backlog started with.
+        if (_sched == RR) {
+            it->second.key = max(it->second.key + 1, _round);
+        }
+        it->second.queued++;
+        return it->second.key;
+    }
+
+    uint64_t key = _round;
+    if (_sched == SRPT) {
+        uint64_t size = pkt.flow()._size;
+        DataPacket *dataPkt = dynamic_cast<DataPacket*>(&pkt);
+        uint64_t sent = dataPkt ? dataPkt->seqno() - 1 : 0;
+        if (size == 0) {
+            key = UINT64_MAX;
+        } else {
+            key = (size > sent) ? size - sent : 0;
+        }
+    }
+    _flows[pkt.flow().id] = {key, 1};
+    return key;
+}
+
+void
+HostNic::receivePacket(Packet &pkt)
+{
+    // CONGA: Add congestion metric when packet enters queue
+    DataPacket* dataPkt = dynamic_cast<DataPacket*>(&pkt);
+    if (dataPkt && !dataPkt->isFeedback()) {
+        dataPkt->addCongestion(_queuesize);
+    }
+
+    if (_queuesize + pkt.size() > _maxsize) {
+        pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_DROP);
+        pkt.free();
+        return;
+    }
+
+    pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_ARRIVE);
+    bool queueWasEmpty = (_currentPkt == NULL) && _packets.empty();
+
+    _packets.push({schedKey(pkt), _arrivals++, &pkt});
+    _queuesize += pkt.size();
+
+    if (queueWasEmpty) {
+        beginService();
+    }
+}
+
+void
+HostNic::beginService()
+{
+    if (_packets.empty()) {
+        return;
+    }
+
+    const Entry &e = _packets.top();
+    _currentPkt = e.pkt;
+
+    if (_sched != FIFO) {
+        if (_sched == RR) {
+            _round = e.key;
+        }
+        auto it = _flows.find(_currentPkt->flow().id);
+        if (--it->second.queued == 0) {
+            _flows.erase(it);
+        }
+    }
+    _packets.pop();
+
+    EventList::Get().sourceIsPendingRel(*this, drainTime(_currentPkt));
+}
+
+void
+HostNic::completeService()
+{
+    _currentPkt->flow().logTraffic(*_currentPkt, *this, TrafficLogger::PKT_DEPART);
+
+    applyEcnMark(*_currentPkt);
+    addTelemetry(*_currentPkt);
+    _currentPkt->sendOn();
+
+    // Clear packet being transmitted.
+    _queuesize -= _currentPkt->size();
+    _currentPkt = NULL;
+
+    beginService();
+}
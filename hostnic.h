@@ -0,0 +1,85 @@
+/*
+ * Host NIC header
+ */
+#ifndef HOSTNIC_H
+#define HOSTNIC_H
+
+#include "queue.h"
+
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Transmit queue of a server's NIC, shared by every flow the server sends.
+ *
+ * Flows from the same host contend for the NIC instead of each having a
+ * line-rate queue of its own. The scheduler decides which flow's packet
+ * goes next:
+ *
+ *  FIFO  in arrival order.
+ *  RR    round robin over the backlogged flows, one packet per round
+ *        (start-time fair queueing with equal sized packets).
+ *  SRPT  the flow with the fewest bytes left to send, taken from
+ *        PacketFlow::_size and the sequence number of the packet that
+ *        started the flow's current backlog.
+ *
+ * Packets wait in one heap ordered by the scheduler's key, so no scheduler
+ * keeps a queue per flow; a flow's packets share or grow its key, which
+ * keeps them in order. When the buffer is full arrivals are dropped.
+ */
+class HostNic : public Queue
+{
+    public:
+        enum Scheduler {
+            FIFO,
+            RR,
+            SRPT
+        };
+
+        // The NIC of a host, created on first use with the given settings.
+        static HostNic& forHost(uint32_t host, linkspeed_bps bitrate, mem_b maxsize,
+                Scheduler sched);
+
+        void receivePacket(Packet &pkt);
+
+    protected:
+        void beginService();
+        void completeService();
+
+    private:
+        HostNic(linkspeed_bps bitrate, mem_b maxsize, Scheduler sched);
+
+        struct Entry {
+            uint64_t key;    // Scheduler order, lowest first.
+            uint64_t order;  // Arrival order, breaks ties.
+            Packet *pkt;
+
+            bool operator>(const Entry &e) const {
+                return key > e.key || (key == e.key && order > e.order);
+            }
+        };
+
+        // Scheduler state of a backlogged flow.
+        struct FlowState {
+            uint64_t key;    // Key of the flow's last queued packet.
+            uint32_t queued; // Packets of the flow in the NIC.
+        };
+
+        uint64_t schedKey(Packet &pkt);
+
+        Scheduler _sched;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> _packets;
+        uint64_t _arrivals;
+
+        // Backlogged flows by flow id, and for RR the round in service.
+        std::unordered_map<uint32_t, FlowState> _flows;
+        uint64_t _round;
+
+        // Current packet being serviced.
+        Packet *_currentPkt;
+
+        static std::vector<HostNic*> _nics;
+};
+
+#endif /* HOSTNIC_H */
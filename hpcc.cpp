@@ -0,0 +1,276 @@
+/*
+ * HPCC and Swift
+ */
+#include "hpcc.h"
+#include "flow-generator.h"
+
+#include <algorithm>
+
+using namespace std;
+
+HpccSrc::HpccSrc(TrafficLogger *pktlogger,
+                 uint64_t flowsize,
+                 Mode mode)
+    : DataSource(pktlogger, flowsize, 0),
+      _state(IDLE),
+      _mode(mode),
+      _cwnd(INT_INIT_WINDOW),
+      _dupacks(0),
+      _recover_seq(0),
+      _rtt(0),
+      _min_rtt(0),
+      _rto(timeFromUs(MIN_RTO_US)),
+      _rto_timeout(0),
+      _wc(INT_INIT_WINDOW),
+      _u(0),
+      _inc_stage(0),
+      _last_update_seq(0),
+      _nLastHops(0),
+      _last_decrease(0)
+{
+    // Constructor
+}
+
+void
+HpccSrc::printStatus()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    cout << setprecision(6) << "LiveFlow " << str() << " size " << _flowsize
+         << " start " << lround(timeAsUs(_start_time)) << " end " << _last_acked
+         << " sent " << _highest_sent << " " << _packets_sent - _highest_sent
+         << " cwnd " << _cwnd
+         << " rate " << _last_acked * 8000.0 / (current_ts - _start_time) << endl;
+}
+
+void
+HpccSrc::doNextEvent()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    _wakeup_at = 0;
+
+    if (_state == IDLE) {
+        _state = ACTIVE;
+        sendPackets();
+    }
+
+    // Cleanup the finished flow.
+    else if (_state == FINISH) {
+        if (_flow._nPackets == 0) {
+            release();
+            return;
+        }
+
+        // Woken again when the last packet of the flow is gone.
+        _flow.setWaiter(this);
+        return;
+    }
+
+    // No progress for a while: resend everything not acked.
+    else if (_rto_timeout != 0 && current_ts >= _rto_timeout) {
+        refreshRoutes();
+        _highest_sent = _last_acked;
+        _recover_seq = 0;
+        _dupacks = 0;
+        _rto_timeout = 0;
+        sendPackets();
+    }
+
+    _wakeup_at = current_ts + _rto;
+    EventList::Get().sourceIsPending(*this, _wakeup_at);
+}
+
+void
+HpccSrc::receivePacket(Packet &pkt)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    DataAck *p = (DataAck*)(&pkt);
+    DataAck::seq_t seqno = p->ackno();
+    simtime_picosec ts = p->ts();
+
+    if (_state == FINISH) {
+        pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
+        p->free();
+        return;
+    }
+
+    if (seqno >= _flowsize) {
+        pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
+        p->free();
+
+        if (_flowgen != NULL) {
+            _flowgen->finishFlow(id);
+        }
+        _state = FINISH;
+
+        cout << setprecision(6) << "Flow " << str() << " " << id << " size " << _flowsize
+             << " start " << lround(timeAsUs(_start_time)) << " end " << lround(timeAsUs(current_ts))
+             << " fct " << timeAsUs(current_ts - _start_time)
+             << " sent " << _highest_sent << " " << _packets_sent - _highest_sent
+             << " tput " << _flowsize * 8000.0 / (current_ts - _start_time)
+             << " rtt " << timeAsUs(_rtt)
+             << " cwnd " << _cwnd << endl;
+
+        if (_flow._nPackets == 0) {
+            release();
+        }
+        return;
+    }
+
+    simtime_picosec m = current_ts - ts;
+    _rtt = (_rtt == 0) ? m : (_rtt * 7 + m) / 8;
+    _min_rtt = (_min_rtt == 0) ? m : min(_min_rtt, m);
+    _rto = max(4 * _rtt, timeFromUs(MIN_RTO_US));
+
+    if (_mode == HPCC) {
+        hpccUpdate(seqno, p->hops(), p->nHops());
+    } else {
+        swiftUpdate(m, p->nHops(), seqno > _last_acked ? seqno - _last_acked : 0);
+    }
+
+    pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
+    p->free();
+
+    if (seqno > _last_acked) {
+        _last_acked = seqno;
+        _dupacks = 0;
+        _rto_timeout = (_last_acked < _highest_sent) ? current_ts + _rto : 0;
+    } else if (seqno == _last_acked && _last_acked < _highest_sent) {
+        // Resend the first missing segment, once per window.
+        if (++_dupacks == 3 && _last_acked >= _recover_seq) {
+            _recover_seq = _highest_sent;
+            sendSegment(_last_acked + 1);
+        }
+    }
+
+    sendPackets();
+}
+
+void
+HpccSrc::hpccUpdate(uint64_t seqno,
+                    const IntHop *hops,
+                    uint32_t nhops)
+{
+    double T = timeAsSec(_min_rtt);
+
+    // Utilization of the busiest hop since the last ack, comparing hop by
+    // hop only while the path looks the same.
+    double u = 0;
+    double tau = T;
+    if (nhops == _nLastHops) {
+        for (uint32_t i = 0; i < nhops; i++) {
+            const IntHop &h = hops[i], &l = _lastHops[i];
+            if (h.ts <= l.ts || h.txBytes < l.txBytes || h.rate != l.rate) {
+                continue;
+            }
+
+            double dt = timeAsSec(h.ts - l.ts);
+            double txRate = (h.txBytes - l.txBytes) * 8.0 / dt;
+            double ui = min(h.qlen, l.qlen) * 8.0 / (h.rate * T) + txRate / h.rate;
+            if (ui > u) {
+                u = ui;
+                tau = dt;
+            }
+        }
+    }
+
+    _nLastHops = nhops;
+    copy(hops, hops + nhops, _lastHops);
+
+    tau = min(tau, T);
+    _u = (1 - tau / T) * _u + (tau / T) * u;
+
+    // The reference window moves once per RTT.
+    bool update = false;
+    if (seqno > _last_update_seq) {
+        update = true;
+        _last_update_seq = _highest_sent;
+    }
+
+    double w;
+    if (_u >= HPCC_ETA || _inc_stage >= HPCC_MAX_STAGE) {
+        w = _wc / (_u / HPCC_ETA) + HPCC_WAI;
+        if (update) {
+            _inc_stage = 0;
+        }
+    } else {
+        w = _wc + HPCC_WAI;
+        if (update) {
+            _inc_stage++;
+        }
+    }
+
+    w = min(max(w, (double)MSS_BYTES), (double)INT_INIT_WINDOW);
+    if (update) {
+        _wc = w;
+    }
+    _cwnd = w;
+}
+
+void
+HpccSrc::swiftUpdate(simtime_picosec delay,
+                     uint32_t nhops,
+                     uint64_t acked)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    simtime_picosec target = SWIFT_BASE_TARGET + nhops * SWIFT_HOP_SCALE;
+
+    if (delay < target) {
+        _cwnd += SWIFT_AI * MSS_BYTES * acked / _cwnd;
+    } else if (current_ts - _last_decrease >= _rtt) {
+        double excess = (double)(delay - target) / delay;
+        _cwnd *= max(1 - SWIFT_BETA * excess, 1 - SWIFT_MAX_MDF);
+        _last_decrease = current_ts;
+    }
+
+    _cwnd = min(max(_cwnd, (double)MSS_BYTES), (double)INT_INIT_WINDOW);
+}
+
+void
+HpccSrc::sendPackets()
+{
+    while (_highest_sent < _flowsize && _highest_sent + MSS_BYTES <= _last_acked + _cwnd) {
+        sendSegment(_highest_sent + 1);
+        _highest_sent += MSS_BYTES;
+    }
+}
+
+void
+HpccSrc::sendSegment(uint64_t seqno)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    DataPacket *p = DataPacket::newpkt(_flow, _route_fwd, seqno, MSS_BYTES);
+    p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
+    p->set_ts(current_ts);
+    p->setFlag(Packet::INT);
+
+    _packets_sent += MSS_BYTES;
+    p->sendOn();
+
+    if (_rto_timeout == 0) {
+        _rto_timeout = current_ts + _rto;
+    }
+}
+
+
+HpccSink::HpccSink()
+    : DataSink()
+{}
+
+void
+HpccSink::receivePacket(Packet &pkt)
+{
+    DataPacket *p = (DataPacket*)(&pkt);
+    processDataPacket(*p);
+
+    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, 1, cumulative_ack());
+    ack->flow().logTraffic(*ack, *this, TrafficLogger::PKT_CREATESEND);
+    ack->set_ts(p->ts());
+    ack->setHops(*p);
+
+    pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
+    p->free();
+
+    ack->sendOn();
+}
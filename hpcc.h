@@ -0,0 +1,108 @@
+/*
+ * HPCC and Swift header
+ */
+#ifndef HPCC_H
+#define HPCC_H
+
+#include "eventlist.h"
+#include "datasource.h"
+
+// Starting and largest window: about one BDP of a 10Gbps host link.
+#define INT_INIT_WINDOW (16 * MSS_BYTES)
+
+// HPCC: target utilization, additive increase in bytes, and the number of
+// additive steps taken before the next multiplicative one.
+#define HPCC_ETA 0.95
+#define HPCC_WAI 150
+#define HPCC_MAX_STAGE 5
+
+// Swift: increase in segments per RTT, decrease scaling and the largest
+// cut per RTT. The delay target grows with the number of queues crossed.
+#define SWIFT_AI 1.0
+#define SWIFT_BETA 0.8
+#define SWIFT_MAX_MDF 0.5
+#define SWIFT_BASE_TARGET timeFromUs(10)
+#define SWIFT_HOP_SCALE timeFromUs(1)
+
+class HpccSink;
+
+/*
+ * Window based sender driven by in-band network telemetry.
+ *
+ * Data packets are flagged Packet::INT, so every queue on the way records
+ * its occupancy, bytes sent and rate on them (Queue::addTelemetry), and the
+ * sink echoes the records on each ack. Two window controls share this:
+ *
+ *  HPCC sets the window multiplicatively from the most utilized hop, with
+ *  utilization taken from the queue length and the tx rate between two
+ *  acks. The reference window moves once per RTT, a few additive steps at
+ *  a time, as in the HPCC paper.
+ *
+ *  Swift compares the RTT to a target that grows with the hop count:
+ *  additive increase below it, and a cut proportional to the excess, at
+ *  most once per RTT, above it.
+ *
+ * The base RTT is the lowest seen. A lost packet is resent after three
+ * duplicate acks, and everything not acked after a timeout.
+ */
+class HpccSrc : public DataSource, public Pooled<HpccSrc>
+{
+    friend class HpccSink;
+    public:
+        enum Mode {
+            HPCC,
+            SWIFT
+        };
+
+        HpccSrc(TrafficLogger *pktlogger, uint64_t flowsize, Mode mode);
+
+        void printStatus();
+        void doNextEvent();
+        void receivePacket(Packet &pkt);
+
+        // Flow status.
+        enum FlowStatus {
+            IDLE,
+            ACTIVE,
+            FINISH
+        } _state;
+
+        Mode _mode;
+        double _cwnd;                 // Window in bytes.
+
+        uint16_t _dupacks;
+        uint64_t _recover_seq;
+
+        simtime_picosec _rtt, _min_rtt, _rto;
+        simtime_picosec _rto_timeout;
+
+    private:
+        void sendPackets();
+        void sendSegment(uint64_t seqno);
+
+        // Window updates on each new ack.
+        void hpccUpdate(uint64_t seqno, const IntHop *hops, uint32_t nhops);
+        void swiftUpdate(simtime_picosec delay, uint32_t nhops, uint64_t acked);
+
+        // HPCC state: reference window, smoothed utilization, additive
+        // steps since the last multiplicative one, and the hops last seen.
+        double _wc;
+        double _u;
+        uint32_t _inc_stage;
+        uint64_t _last_update_seq;
+        uint32_t _nLastHops;
+        IntHop _lastHops[MAX_INT_HOPS];
+
+        // Swift state.
+        simtime_picosec _last_decrease;
+};
+
+class HpccSink : public DataSink, public Pooled<HpccSink>
+{
+    friend class HpccSrc;
+    public:
+        HpccSink();
+        void receivePacket(Packet &pkt);
+};
+
+#endif /* HPCC_H */
@@ -8,6 +8,40 @@ static inline double ewma(double oldv, double newv, double alpha) {
     return alpha * newv + (1.0 - alpha) * oldv;
 }
 
+DownlinkTable::DownlinkTable(uint32_t n_cores,
+                             uint32_t n_leaves)
+    : EventSource("DownlinkTable"),
+      _nCores(n_cores),
+      _nLeaves(n_leaves),
+      _coreToLeafQ((size_t)n_leaves * n_cores, nullptr),
+      _coreToLeafP((size_t)n_leaves * n_cores, nullptr),
+      _fromLeaf((size_t)n_leaves * n_cores, 0.0),
+      _alpha(0.6),
+      _samplePeriod(timeFromUs(5))
+{
+    // Kick off periodic sampling
+    EventList::Get().sourceIsPending(*this, EventList::Get().now());
+}
+
+void DownlinkTable::registerCoreToLeaf(uint32_t core,
+                                       uint32_t dstLeaf,
+                                       Queue* q,
+                                       Pipe* p)
+{
+    assert(core < _nCores && dstLeaf < _nLeaves);
+    _coreToLeafQ[dstLeaf * _nCores + core] = q;
+    _coreToLeafP[dstLeaf * _nCores + core] = p;
+}
+
+void DownlinkTable::doNextEvent() {
+    for (size_t i = 0; i < _coreToLeafQ.size(); ++i) {
+        Queue* q_down = _coreToLeafQ[i];
+        if (!q_down) continue;
+        _fromLeaf[i] = ewma(_fromLeaf[i], (double)q_down->_queuesize, _alpha);
+    }
+    EventList::Get().sourceIsPendingRel(*this, _samplePeriod);
+}
+
 LeafSwitch::LeafSwitch(uint32_t leaf_id,
                        uint32_t n_cores,
                        uint32_t n_leaves,
@@ -17,61 +51,67 @@ LeafSwitch::LeafSwitch(uint32_t leaf_id,
       _nCores(n_cores),
       _nLeaves(n_leaves),
       _uplinkQ(n_cores, nullptr),
-      _coreToLeafQ(n_leaves, std::vector<Queue*>(n_cores, nullptr)),
-      _toLeaf(n_leaves, std::vector<double>(n_cores, 0.0)),
-      _fromLeaf(n_leaves, std::vector<double>(n_cores, 0.0)),
-      _metric(n_leaves, std::vector<double>(n_cores, 0.0)),
+      _uplinkP(n_cores, nullptr),
+      _toCore(n_cores, 0.0),
+      _downlinks(nullptr),
       _alpha(0.6),                             // faster tracking than 0.25
       _samplePeriod(timeFromUs(5)),            // 5 µs sampling (was 50 µs)
       _w_to(0.5), _w_from(0.5),                // equal weight by default
       _eps(1e-3),
       _rng(0xBADA551u + leaf_id)               // leaf-unique seed
 {
-    // Symmetry-breaking jitter so early ties don't stick to core 0
+    // Symmetry-breaking jitter for every (dst leaf, core). The first sample,
+    // at time 0, replaces it before any core is chosen, so it is not kept;
+    // its draws are, so the tie-breaks below follow the same sequence.
     std::uniform_real_distribution<double> J(0.0, 1e-2);
-    for (uint32_t d = 0; d < _nLeaves; ++d) {
-        for (uint32_t c = 0; c < _nCores; ++c) {
-            _metric[d][c] = J(_rng);
-        }
+    for (uint64_t i = 0; i < (uint64_t)_nLeaves * _nCores; ++i) {
+        J(_rng);
     }
 
     // Kick off periodic sampling
     EventList::Get().sourceIsPending(*this, EventList::Get().now());
 }
 
-void LeafSwitch::addUplink(uint32_t core, Queue* q, Pipe* /*p*/) {
+void LeafSwitch::addUplink(uint32_t core, Queue* q, Pipe* p) {
     assert(core < _nCores);
     _uplinkQ[core] = q;
+    _uplinkP[core] = p;
 }
 
 void LeafSwitch::addDownlink(uint32_t /*sid*/, Queue* /*q*/, Pipe* /*p*/) {
     // not needed for path choice in this simplified model
 }
 
-void LeafSwitch::registerCoreToLeaf(uint32_t core,
-                                    uint32_t dstLeaf,
-                                    Queue* q, Pipe* /*p*/)
-{
-    assert(core < _nCores && dstLeaf < _nLeaves);
-    _coreToLeafQ[dstLeaf][core] = q;
-}
-
 uint32_t LeafSwitch::chooseCore(uint32_t dstLeaf) const {
     assert(dstLeaf < _nLeaves);
 
+    // Combined DRE-like metric, failed paths are never the best
+    auto metric = [&](uint32_t c) {
+        if ((_uplinkP[c] && _uplinkP[c]->failed()) ||
+            (_downlinks && !_downlinks->up(dstLeaf, c)))
+            return std::numeric_limits<double>::infinity();
+        double from = _downlinks ? _downlinks->congestion(dstLeaf, c) : 0.0;
+        return _w_to * _toCore[c] + _w_from * from;
+    };
+
     // Find minimum metric
     double best = std::numeric_limits<double>::infinity();
+    size_t nCand = 0;
+    for (uint32_t c = 0; c < _nCores; ++c) {
+        double m = metric(c);
+        if (m < best) best = m;
+    }
+
+    // Choose uniformly at random among all cores within epsilon of best
     for (uint32_t c = 0; c < _nCores; ++c)
-        best = std::min(best, _metric[dstLeaf][c]);
+        if (metric(c) <= best + _eps) ++nCand;
 
-    // Collect all cores within epsilon of best and choose uniformly at random
-    std::vector<uint32_t> cand;
-    cand.reserve(_nCores);
+    std::uniform_int_distribution<size_t> U(0, nCand - 1);
+    size_t pick = U(_rng);
     for (uint32_t c = 0; c < _nCores; ++c)
-        if (_metric[dstLeaf][c] <= best + _eps) cand.push_back(c);
+        if (metric(c) <= best + _eps && pick-- == 0) return c;
 
-    std::uniform_int_distribution<size_t> U(0, cand.size() - 1);
-    return cand[U(_rng)];
+    return 0;
 }
 
 void LeafSwitch::doNextEvent() {
@@ -80,22 +120,10 @@ void LeafSwitch::doNextEvent() {
 }
 
 void LeafSwitch::sampleOnce() {
-    // For each dst leaf and core, get local uplink & remote downlink occupancies
-    for (uint32_t dst = 0; dst < _nLeaves; ++dst) {
-        for (uint32_t c = 0; c < _nCores; ++c) {
-            Queue* q_up   = _uplinkQ[c];
-            Queue* q_down = _coreToLeafQ[dst][c];
-            if (!q_up || !q_down) continue;
-
-            // Your Queue exposes current occupancy via public _queuesize (bytes)
-            double to_val   = (double)q_up->_queuesize;
-            double from_val = (double)q_down->_queuesize;
-
-            _toLeaf[dst][c]   = ewma(_toLeaf[dst][c],   to_val,   _alpha);
-            _fromLeaf[dst][c] = ewma(_fromLeaf[dst][c], from_val, _alpha);
-
-            // Combined DRE-like metric
-            _metric[dst][c] = _w_to * _toLeaf[dst][c] + _w_from * _fromLeaf[dst][c];
-        }
+    // Local uplink occupancy, via the Queue's public _queuesize (bytes)
+    for (uint32_t c = 0; c < _nCores; ++c) {
+        Queue* q_up = _uplinkQ[c];
+        if (!q_up) continue;
+        _toCore[c] = ewma(_toCore[c], (double)q_up->_queuesize, _alpha);
     }
 }
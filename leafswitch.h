@@ -7,6 +7,46 @@
 #include "queue.h"
 #include "pipe.h"
 
+// EWMA congestion of every core -> leaf downlink, indexed [dstLeaf][core].
+// Every leaf looks at the same remote queues, so the table is sampled once
+// per period for the whole fabric and shared by all LeafSwitches instead of
+// being replicated (and resampled) in each of them.
+class DownlinkTable : public EventSource {
+public:
+    DownlinkTable(uint32_t n_cores, uint32_t n_leaves);
+
+    // Remote segment registration: core -> dstLeaf downlink
+    void registerCoreToLeaf(uint32_t core, uint32_t dstLeaf, Queue* q_core_to_leaf,
+                            Pipe* p_core_to_leaf = nullptr);
+
+    inline double congestion(uint32_t dstLeaf, uint32_t core) const {
+        return _fromLeaf[dstLeaf * _nCores + core];
+    }
+
+    // False once the core -> dstLeaf link has failed
+    inline bool up(uint32_t dstLeaf, uint32_t core) const {
+        Pipe* p = _coreToLeafP[dstLeaf * _nCores + core];
+        return !p || !p->failed();
+    }
+
+    // Tunables
+    void setSamplingPeriod(simtime_picosec T) { _samplePeriod = T; }
+    void setAlpha(double a) { _alpha = a; }
+
+    void doNextEvent() override;
+
+private:
+    uint32_t _nCores, _nLeaves;
+
+    // Flat [dstLeaf][core] arrays.
+    std::vector<Queue*> _coreToLeafQ;
+    std::vector<Pipe*> _coreToLeafP;
+    std::vector<double> _fromLeaf;
+
+    double _alpha;
+    simtime_picosec _samplePeriod;
+};
+
 class LeafSwitch : public EventSource {
 public:
     LeafSwitch(uint32_t leaf_id,
@@ -17,10 +57,11 @@ public:
     void addUplink(uint32_t core, Queue* q_leaf_to_core, Pipe* p_leaf_to_core);
     void addDownlink(uint32_t /*server_global_id*/, Queue* /*q*/, Pipe* /*p*/);
 
-    // Remote segment registration: core -> dstLeaf downlink
-    void registerCoreToLeaf(uint32_t core, uint32_t dstLeaf, Queue* q_core_to_leaf, Pipe* p_core_to_leaf);
+    // Remote congestion toward each dst leaf, shared across the fabric.
+    void setDownlinkTable(const DownlinkTable* table) { _downlinks = table; }
 
-    // Pick the core uplink for a packet going to dstLeaf
+    // Pick the core uplink for a packet going to dstLeaf, skipping cores
+    // whose uplink or downlink to dstLeaf has failed
     uint32_t chooseCore(uint32_t dstLeaf) const;
 
     // Tunables
@@ -38,18 +79,13 @@ private:
 
     // leaf -> core (local uplinks)
     std::vector<Queue*> _uplinkQ; // size nCores
-
-    // core -> leaf queues indexed [dstLeaf][core]
-    std::vector<std::vector<Queue*>> _coreToLeafQ;
+    std::vector<Pipe*> _uplinkP;  // size nCores
 
     // CONGA-style tables (EWMA of bytes-in-queue)
-    // toLeaf[dst][core]   := local leaf->core congestion toward dst leaf
-    // fromLeaf[dst][core] := remote core->dstLeaf congestion learned/sampled
-    std::vector<std::vector<double>> _toLeaf;
-    std::vector<std::vector<double>> _fromLeaf;
-
-    // Combined metric used for routing: metric = w_to*toLeaf + w_from*fromLeaf (+ jitter)
-    std::vector<std::vector<double>> _metric;
+    // toCore[core]          := local leaf->core congestion (same for every dst leaf)
+    // downlinks(dst, core)  := remote core->dstLeaf congestion, shared
+    std::vector<double> _toCore;
+    const DownlinkTable* _downlinks;
 
     // EWMA, period, weights, tie threshold
     double _alpha;
@@ -57,6 +93,6 @@ private:
     double _w_to, _w_from;
     double _eps;
 
-    // Jitter to break symmetry
+    // Random tie-breaking among equally good cores
     mutable std::mt19937 _rng;
 };
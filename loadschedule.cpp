@@ -0,0 +1,182 @@
+/*
+ * Load schedule
+ */
+#include "loadschedule.h"
+
+#include <algorithm>
+
+using namespace std;
+
+LoadSchedule::LoadSchedule(const string &spec,
+                           bool ramp)
+    : EventSource("LoadSchedule"),
+    _ramp(ramp),
+    _nextMarker(0),
+    _reportTime(0)
+{
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == string::npos) {
+            end = spec.size();
+        }
+
+        string item = spec.substr(start, end - start);
+        size_t colon = item.find(':');
+        if (colon == string::npos) {
+            fprintf(stderr, "Bad load schedule point: %s\n", item.c_str());
+            exit(1);
+        }
+
+        Point p;
+        p.time = timeFromSec(stod(item.substr(0, colon)));
+        p.load = stod(item.substr(colon + 1));
+        if (p.load < 0 || (!_points.empty() && p.time <= _points.back().time)) {
+            fprintf(stderr, "Load schedule points need a later time and a load >= 0: %s\n",
+                    item.c_str());
+            exit(1);
+        }
+        _points.push_back(p);
+
+        start = end + 1;
+    }
+
+    if (_points.empty()) {
+        fprintf(stderr, "Empty load schedule\n");
+        exit(1);
+    }
+
+    _fcts.resize(_points.size());
+}
+
+int
+LoadSchedule::phase(simtime_picosec t) const
+{
+    auto it = upper_bound(_points.begin(), _points.end(), t,
+            [](simtime_picosec t, const Point &p) {return t < p.time;});
+    return (int)(it - _points.begin()) - 1;
+}
+
+double
+LoadSchedule::load(simtime_picosec t) const
+{
+    int i = phase(t);
+    if (i < 0) {
+        return _points[0].load;
+    }
+    if (!_ramp || i + 1 == (int)_points.size()) {
+        return _points[i].load;
+    }
+
+    const Point &a = _points[i], &b = _points[i + 1];
+    return a.load + (b.load - a.load) * (t - a.time) / (double)(b.time - a.time);
+}
+
+double
+LoadSchedule::peak() const
+{
+    double l = 0;
+    for (const Point &p : _points) {
+        l = max(l, p.load);
+    }
+    return l;
+}
+
+simtime_picosec
+LoadSchedule::nextArrival(simtime_picosec now,
+                          double meanGap,
+                          double base) const
+{
+    simtime_picosec t = now;
+
+    while (true) {
+        // End of the phase holding t, and the highest rate up to it.
+        int i = phase(t);
+        simtime_picosec end = (i + 1 < (int)_points.size()) ? _points[i + 1].time : UINT64_MAX;
+        double l = load(t);
+        double lmax = (_ramp && end != UINT64_MAX) ? max(l, _points[i + 1].load) : l;
+
+        if (lmax == 0) {
+            if (end == UINT64_MAX) {
+                return UINT64_MAX;
+            }
+            t = end;
+            continue;
+        }
+
+        // Arrivals are memoryless, so one that falls past the phase end is
+        // drawn again from there.
+        double rate = (lmax / base) / meanGap;
+        simtime_picosec gap = exponential(rate);
+        if (gap >= end - t) {
+            t = end;
+            continue;
+        }
+        t += gap;
+
+        // Within a ramp, keep the arrival with probability load / lmax.
+        if (l == lmax || drand() * lmax <= load(t)) {
+            return t;
+        }
+    }
+}
+
+void
+LoadSchedule::flowFinished(simtime_picosec start,
+                           simtime_picosec end)
+{
+    int i = max(phase(start), 0);
+    _fcts[i].push_back(timeAsUs(end - start));
+}
+
+void
+LoadSchedule::start(simtime_picosec reportTime)
+{
+    _reportTime = reportTime;
+    if (_points[0].time < reportTime) {
+        EventList::Get().sourceIsPending(*this, _points[0].time);
+    }
+    EventList::Get().sourceIsPending(*this, reportTime);
+}
+
+void
+LoadSchedule::doNextEvent()
+{
+    simtime_picosec now = EventList::Get().now();
+
+    if (now == _reportTime) {
+        report();
+        return;
+    }
+
+    const Point &p = _points[_nextMarker];
+    cout << "Phase " << _nextMarker << " start " << lround(timeAsUs(p.time))
+         << " load " << p.load << endl;
+
+    _nextMarker++;
+    if (_nextMarker < _points.size() && _points[_nextMarker].time < _reportTime) {
+        EventList::Get().sourceIsPending(*this, _points[_nextMarker].time);
+    }
+}
+
+void
+LoadSchedule::report()
+{
+    for (uint32_t i = 0; i < _fcts.size(); i++) {
+        vector<double> &f = _fcts[i];
+        sort(f.begin(), f.end());
+
+        double mean = 0;
+        for (double fct : f) {
+            mean += fct;
+        }
+
+        cout << setprecision(6) << "PhaseStats " << i << " load " << _points[i].load
+             << " flows " << f.size();
+        if (!f.empty()) {
+            cout << " mean " << mean / f.size() << " p50 " << f[f.size() / 2]
+                 << " p99 " << f[min(f.size() - 1, f.size() * 99 / 100)];
+        }
+        cout << endl;
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Load schedule header
+ */
+#ifndef LOADSCHEDULE_H
+#define LOADSCHEDULE_H
+
+#include "eventlist.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Offered load over simulated time, shared by the flow generators of a run.
+ *
+ * The schedule is a list of "<seconds>:<load>" points, e.g.
+ * "0:0.1,3:0.2,6:0.3". Each phase holds its load until the next point, or
+ * with ramp set moves linearly towards it; the last load holds to the end.
+ * A generator scales its rate by load(t) / base, where base is the load
+ * its rate was computed for, and draws arrivals as a Poisson process of
+ * that varying rate (thinning within ramps), so a single run can step
+ * through a whole load sweep.
+ *
+ * The schedule prints a "Phase" marker as each phase starts, and at the
+ * report time a "PhaseStats" line per phase for the flows started in it:
+ * how many finished, and their mean, median and 99th percentile FCT.
+ */
+class LoadSchedule : public EventSource
+{
+    public:
+        // Parses the points of spec. Exits on a malformed one.
+        LoadSchedule(const std::string &spec, bool ramp);
+
+        // Offered load at time t, and the highest load of the schedule.
+        double load(simtime_picosec t) const;
+        double peak() const;
+
+        // Time of the first arrival after now, for a generator with mean gap
+        // meanGap between arrivals at load base. UINT64_MAX if there is none.
+        simtime_picosec nextArrival(simtime_picosec now, double meanGap, double base) const;
+
+        // Records the FCT of a flow that started at start.
+        void flowFinished(simtime_picosec start, simtime_picosec end);
+
+        // Prints phase markers from now on, and the statistics at reportTime.
+        void start(simtime_picosec reportTime);
+
+        void doNextEvent();
+
+        // Prints the statistics, as due at the report time.
+        void report();
+
+    private:
+        // Phase containing t, or -1 before the first point.
+        int phase(simtime_picosec t) const;
+
+        struct Point {
+            simtime_picosec time;
+            double load;
+        };
+
+        std::vector<Point> _points;
+        bool _ramp;
+
+        // Next phase to mark, and when to report.
+        uint32_t _nextMarker;
+        simtime_picosec _reportTime;
+
+        // FCTs in microseconds of the flows started in each phase.
+        std::vector<std::vector<double> > _fcts;
+};
+
+#endif /* LOADSCHEDULE_H */
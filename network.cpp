@@ -2,12 +2,13 @@
  * Network
  */
 #include "network.h"
+#include "eventlist.h"
 
 uint32_t Logged::LASTIDNUM = 1;
 
 void
 Packet::set(PacketFlow &flow,
-            route_t &route,
+            const Route &route,
             mem_b pkt_size,
             packetid_t id)
 {
@@ -25,7 +26,7 @@ Packet::sendOn()
 {
     assert(_nexthop<_route->size());
 
-    PacketSink *nextsink = (*_route)[_nexthop];
+    PacketSink *nextsink = _route->hop(_nexthop);
     _nexthop++;
 
     nextsink->receivePacket(*this);
@@ -34,9 +35,20 @@ Packet::sendOn()
 PacketFlow::PacketFlow(TrafficLogger *logger)
                       : Logged("PacketFlow"), 
                       _nPackets(0), 
-                      _logger(logger)
+                      _size(0),
+                      _logger(logger),
+                      _waiter(NULL)
 {}
 
+void
+PacketFlow::wake()
+{
+    if (_waiter != NULL) {
+        EventList::Get().sourceIsPendingRel(*_waiter, 0);
+        _waiter = NULL;
+    }
+}
+
 void
 PacketFlow::logTraffic(Packet &pkt, 
                        Logged &location, 
@@ -16,6 +16,40 @@ typedef std::vector<PacketSink*> route_t;
 typedef std::vector<route_t*> routes_t;
 typedef uint32_t packetid_t;
 
+/*
+ * Path of a packet through the network. The hop list is shared and must
+ * not change while flows use it: all flows between the same servers over
+ * the same path point at one interned route_t (see Topology::route()).
+ * The only per-flow state is an optional first hop, such as the flow's
+ * endhost queue, and the endpoint that consumes the packet.
+ */
+class Route
+{
+    public:
+        Route() : _hops(NULL), _nHops(0), _head(NULL), _endpoint(NULL) {}
+        Route(const route_t &hops, PacketSink *endpoint, PacketSink *head = NULL)
+            : _hops(hops.data()), _nHops(hops.size()), _head(head), _endpoint(endpoint) {}
+
+        // Number of hops, including the head and the endpoint.
+        inline uint32_t size() const {return _nHops + 1 + (_head != NULL);}
+
+        inline PacketSink* hop(uint32_t i) const {
+            if (_head != NULL) {
+                if (i == 0) {
+                    return _head;
+                }
+                i--;
+            }
+            return (i < _nHops) ? _hops[i] : _endpoint;
+        }
+
+    private:
+        PacketSink * const *_hops; // Shared hop list.
+        uint32_t _nHops;
+        PacketSink *_head;         // Per-flow first hop, if any.
+        PacketSink *_endpoint;     // Per-flow last hop.
+};
+
 // See datapacket.h to illustrate how Packet is typically used.
 class Packet
 {
@@ -26,7 +60,8 @@ class Packet
         ECN_FWD = 0,
         ECN_REV = 1,
         PP_FIRST = 2,
-        DEADLINE = 3
+        DEADLINE = 3,
+        INT = 4       // Collect in-band telemetry at each queue.
     };
 
     Packet() {};
@@ -51,10 +86,10 @@ class Packet
     inline uint32_t getPriority() {return _priority;}
 
     protected:
-    void set(PacketFlow &flow, route_t &route, mem_b pkt_size, packetid_t id);
+    void set(PacketFlow &flow, const Route &route, mem_b pkt_size, packetid_t id);
 
     PacketFlow *_flow;
-    route_t *_route;
+    const Route *_route;
     mem_b _size;
     packetid_t _id;
 
@@ -64,6 +99,8 @@ class Packet
     uint32_t _priority;
 };
 
+class EventSource;
+
 class PacketFlow : public Logged
 {
     friend class Packet;
@@ -72,11 +109,28 @@ class PacketFlow : public Logged
     virtual ~PacketFlow() {};
     void logTraffic(Packet &pkt, Logged &location, TrafficLogger::TrafficEvent ev);
 
+    // Called by packets as they are freed.
+    inline void packetFreed() {
+        if (--_nPackets == 0 && _waiter != NULL) {
+            wake();
+        }
+    }
+
+    // Has waiter run once, right away, the next time the flow has no
+    // packets left or wake() is called. Finished flows wait this way for
+    // their last packet instead of polling.
+    inline void setWaiter(EventSource *waiter) {_waiter = waiter;}
+    void wake();
+
     // How many packets of this flow are alive.
     uint32_t _nPackets;
 
+    // Bytes the flow sends, 0 if not known in advance.
+    uint64_t _size;
+
     protected:
     TrafficLogger *_logger;
+    EventSource *_waiter;
 };
 
 class PacketSink
@@ -114,4 +168,38 @@ class PacketDB
         std::vector<P*> _freelist; // Irek says it's faster with vector than with list
 };
 
+// The same for the objects every flow creates (sources, sinks, endhost
+// queues): deriving from Pooled<T> gives T a class operator new/delete that
+// recycles the memory of deleted objects instead of going to malloc. The
+// constructor still runs on every new, so reused objects start clean.
+// Subclasses of T that are larger fall through to the global allocator.
+
+template<class T>
+class Pooled
+{
+    public:
+        static void* operator new(size_t size) {
+            if (size != sizeof(T) || _freelist.empty()) {
+                return ::operator new(size);
+            }
+            void *p = _freelist.back();
+            _freelist.pop_back();
+            return p;
+        }
+
+        static void operator delete(void *p, size_t size) {
+            if (size != sizeof(T)) {
+                ::operator delete(p);
+                return;
+            }
+            _freelist.push_back(p);
+        }
+
+    private:
+        static std::vector<void*> _freelist;
+};
+
+template<class T>
+std::vector<void*> Pooled<T>::_freelist;
+
 #endif /* NETWORK_H */
@@ -0,0 +1,149 @@
+/*
+ * Pacer
+ */
+#include "pacer.h"
+
+using namespace std;
+
+simtime_picosec HostPacer::_defaultGranularity = timeFromNs(500);
+vector<HostPacer*> HostPacer::_pacers;
+
+HostPacer::HostPacer()
+    : EventSource("HostPacer"),
+    _granularity(_defaultGranularity),
+    _nEntries(0),
+    _tick(EventList::Get().now() / _defaultGranularity),
+    _timer_at(0)
+{
+    fill(_busy, _busy + WHEEL_SLOTS / 64, 0);
+}
+
+HostPacer&
+HostPacer::forHost(uint32_t host)
+{
+    if (host >= _pacers.size()) {
+        _pacers.resize(host + 1, NULL);
+    }
+    if (_pacers[host] == NULL) {
+        _pacers[host] = new HostPacer();
+    }
+    return *_pacers[host];
+}
+
+void
+HostPacer::setGranularity(simtime_picosec granularity)
+{
+    _defaultGranularity = granularity;
+}
+
+void
+HostPacer::schedule(PacedSource &src,
+                    simtime_picosec when)
+{
+    // Round up, and never into a slot that was already served.
+    uint64_t tick = max((when + _granularity - 1) / _granularity, _tick + 1);
+
+    if (tick - _tick > WHEEL_SLOTS) {
+        _overflow.push({tick, &src});
+    } else {
+        insert(tick, &src);
+    }
+
+    if (_timer_at == 0 || tick * _granularity < _timer_at) {
+        _timer_at = tick * _granularity;
+        EventList::Get().sourceIsPending(*this, _timer_at);
+    }
+}
+
+void
+HostPacer::insert(uint64_t tick,
+                  PacedSource *src)
+{
+    uint32_t s = tick & (WHEEL_SLOTS - 1);
+    _slots[s].push_back({tick, src});
+    _busy[s >> 6] |= (1ULL << (s & 63));
+    _nEntries++;
+}
+
+void
+HostPacer::promote()
+{
+    while (!_overflow.empty() && _overflow.top().tick - _tick <= WHEEL_SLOTS) {
+        insert(_overflow.top().tick, _overflow.top().src);
+        _overflow.pop();
+    }
+}
+
+void
+HostPacer::doNextEvent()
+{
+    simtime_picosec now = EventList::Get().now();
+    if (now != _timer_at) {
+        return;
+    }
+    _timer_at = 0;
+    _tick = now / _granularity;
+    promote();
+
+    // Take out the entries due now; those a turn later stay.
+    uint32_t s = _tick & (WHEEL_SLOTS - 1);
+    vector<Entry> &slot = _slots[s];
+    for (size_t i = 0; i < slot.size(); ) {
+        if (slot[i].tick <= _tick) {
+            _batch.push_back(slot[i]);
+            slot[i] = slot.back();
+            slot.pop_back();
+        } else {
+            i++;
+        }
+    }
+    if (slot.empty()) {
+        _busy[s >> 6] &= ~(1ULL << (s & 63));
+    }
+    _nEntries -= _batch.size();
+
+    // Sources reschedule themselves into later slots as they are served.
+    for (size_t i = 0; i < _batch.size(); i++) {
+        _batch[i].src->pacedSend();
+    }
+    _batch.clear();
+
+    arm();
+}
+
+void
+HostPacer::arm()
+{
+    // The wheel holds one turn, so its first busy slot after this one
+    // comes before any overflow entry.
+    uint64_t next = 0;
+    if (_nEntries == 0) {
+        if (_overflow.empty()) {
+            return;
+        }
+        next = _overflow.top().tick;
+    }
+
+    for (uint32_t step = 1; _nEntries > 0 && step <= WHEEL_SLOTS; ) {
+        uint32_t s = (_tick + step) & (WHEEL_SLOTS - 1);
+        uint64_t word = _busy[s >> 6] >> (s & 63);
+        if (word == 0) {
+            step += 64 - (s & 63);
+            continue;
+        }
+
+        step += __builtin_ctzll(word);
+        if (step > WHEEL_SLOTS) {
+            break;
+        }
+
+        // The slot of the current one holds entries of the next turn.
+        next = _tick + step;
+        break;
+    }
+
+    if (next != 0 && (_timer_at == 0 || next * _granularity < _timer_at)) {
+        _timer_at = next * _granularity;
+        EventList::Get().sourceIsPending(*this, _timer_at);
+    }
+}
@@ -0,0 +1,100 @@
+/*
+ * Pacer header
+ */
+#ifndef PACER_H
+#define PACER_H
+
+#include "eventlist.h"
+
+#include <queue>
+#include <vector>
+
+/*
+ * A sender whose transmissions are spread out in time by a HostPacer.
+ */
+class PacedSource
+{
+    public:
+        virtual ~PacedSource() {};
+
+        // Called by the pacer once the requested send time is reached.
+        virtual void pacedSend() = 0;
+};
+
+/*
+ * Releases the paced senders of one host at their next send times.
+ *
+ * Every paced flow of a host shares the host's pacer, a single EventSource
+ * over a timing wheel of send times, so pacing costs one event per busy
+ * slot rather than a timer per flow or per packet. Only flows with a send
+ * time are on the wheel: a flow that can't send waits off it until an ack
+ * reschedules it. All flows due in a slot are released as one batch.
+ *
+ * Send times are rounded up to the end of their slot, never released
+ * early. Senders should advance their next send time from the previous
+ * ideal one, not from the release time, to keep their average rate.
+ *
+ * Send times more than a turn of the wheel ahead wait in an overflow heap
+ * and move onto the wheel as it comes round to them, so the wheel only
+ * holds its current turn. Long gaps, such as per-host flow arrivals, then
+ * cost a heap operation each rather than a scan of the wheel.
+ */
+class HostPacer : public EventSource
+{
+    public:
+        // The pacer of a host, created on first use.
+        static HostPacer& forHost(uint32_t host);
+
+        // A wheel of its own, e.g. for flow arrivals.
+        HostPacer();
+
+        // Width of a wheel slot, for pacers created after the call.
+        static void setGranularity(simtime_picosec granularity);
+
+        // Calls src.pacedSend() at or just after when. A source must not be
+        // scheduled again before that, nor freed.
+        void schedule(PacedSource &src, simtime_picosec when);
+
+        void doNextEvent();
+
+    private:
+        // Schedules the event for the first busy slot after _tick, or for
+        // the first overflow entry, if any.
+        void arm();
+
+        // Moves the overflow entries within a turn of _tick onto the wheel.
+        void promote();
+
+        // Adds an entry within a turn of _tick to its slot.
+        void insert(uint64_t tick, PacedSource *src);
+
+        static const uint32_t WHEEL_SLOTS = 256;
+
+        struct Entry {
+            uint64_t tick;     // Absolute slot.
+            PacedSource *src;
+        };
+
+        // Orders the overflow heap earliest first.
+        struct Later {
+            bool operator()(const Entry &a, const Entry &b) const {return a.tick > b.tick;}
+        };
+
+        simtime_picosec _granularity;
+        std::vector<Entry> _slots[WHEEL_SLOTS];
+        uint64_t _busy[WHEEL_SLOTS / 64];  // Non-empty slots.
+        uint32_t _nEntries;                // On the wheel.
+        std::priority_queue<Entry, std::vector<Entry>, Later> _overflow;
+
+        uint64_t _tick;                    // Last slot served.
+        std::vector<Entry> _batch;         // Flows released in this slot.
+
+        // Time of the event for the next busy slot, 0 if none. Events
+        // can't be cancelled, so any others scheduled are stale.
+        simtime_picosec _timer_at;
+
+        static simtime_picosec _defaultGranularity;
+        static std::vector<HostPacer*> _pacers;
+};
+
+#endif /* PACER_H */
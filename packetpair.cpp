@@ -82,8 +82,7 @@ PacketPairSrc::doNextEvent()
     else if (_state == FINISH) {
         if (_flow._nPackets == 0 && current_ts > _first_rto) {
             delete _sink;
-            delete _route_fwd;
-            delete _route_rev;
+            delete _endhost_queue;
             delete this;
             return;
         }
@@ -108,6 +107,7 @@ PacketPairSrc::doNextEvent()
         _rto *= 2;
         _rto_timeout = current_ts + _rto;
 
+        refreshRoutes();
         retransmitPacket(current_ts);
     }
 
@@ -381,7 +381,7 @@ PacketPairSrc::transmitPacketPair(simtime_picosec current_ts)
     DataPacket *p;
 
     // Send out first packet.
-    p = DataPacket::newpkt(_flow, *_route_fwd, _highest_sent + 1, MSS_BYTES);
+    p = DataPacket::newpkt(_flow, _route_fwd, _highest_sent + 1, MSS_BYTES);
     p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
     p->set_ts(current_ts);
     p->setFlag(Packet::PP_FIRST);
@@ -400,7 +400,7 @@ PacketPairSrc::transmitPacketPair(simtime_picosec current_ts)
 
     // Send out second packet at the same time (assuming source can
     // transmit at inifinite speed here!)
-    p = DataPacket::newpkt(_flow, *_route_fwd, _highest_sent + 1, MSS_BYTES);
+    p = DataPacket::newpkt(_flow, _route_fwd, _highest_sent + 1, MSS_BYTES);
     p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
     p->set_ts(current_ts);
     p->sendOn();
@@ -417,7 +417,7 @@ PacketPairSrc::retransmitPacket(simtime_picosec current_ts)
     }
 
     DataPacket *p;
-    p = DataPacket::newpkt(_flow, *_route_fwd, _last_acked + 1, MSS_BYTES);
+    p = DataPacket::newpkt(_flow, _route_fwd, _last_acked + 1, MSS_BYTES);
     p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
     p->set_ts(current_ts);
 
@@ -482,7 +482,7 @@ PacketPairSink::receivePacket(Packet& pkt)
              << " PPD " << timeAsUs(_pktpairdiff) << " ECN " << (int)p->getFlag(Packet::ECN_FWD) << endl;
     }
 
-    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, _pktpairdiff, _cumulative_ack);
+    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, _pktpairdiff, cumulative_ack());
     ack->flow().logTraffic(*ack, *this, TrafficLogger::PKT_CREATESEND);
     ack->set_ts(ts);
     if (p->getFlag(Packet::ECN_FWD)) {
@@ -12,7 +12,7 @@
 class PacketPairSink;
 class FlowGenerator;
 
-class PacketPairSrc : public DataSource
+class PacketPairSrc : public DataSource, public Pooled<PacketPairSrc>
 {
 friend class PacketPairSink;
 public:
@@ -67,7 +67,7 @@ private:
     void transmitPacketPair(simtime_picosec current_ts);
 };
 
-class PacketPairSink : public DataSink
+class PacketPairSink : public DataSink, public Pooled<PacketPairSink>
 {
 friend class PacketPairSrc;
 public:
@@ -10,36 +10,60 @@ LOG_DIR, PLOT_DIR = sys.argv[1], sys.argv[2]
 os.makedirs(PLOT_DIR, exist_ok=True)
 
 FLOW_RE = re.compile(
-    r'Flow\s+\S+\s+\d+\s+size\s+(?P<size>\d+).*?fct\s+(?P<fct>[0-9\.eE\+\-]+)',
+    r'Flow\s+\S+\s+\d+\s+size\s+(?P<size>\d+)\s+start\s+(?P<start>\d+).*?fct\s+(?P<fct>[0-9\.eE\+\-]+)',
     re.IGNORECASE
 )
+# Written by --converge: flows that started before the warm-up cut (us) are dropped.
+WARMUP_RE = re.compile(r'^(Not)?Converged at \d+ warmup (?P<warmup>\d+)')
+LIVE_RE = re.compile(r'^Live Flows: (?P<n>\d+)')
+
+# Log names from run_experiments.sh: <policy>_<workload>_U<util>.log
+TAG_RE = re.compile(r'^(?P<policy>[^_]+)_(?P<workload>.+)_U(?P<util>[0-9.]+)\.log$')
 
 def parse_logs():
     data = {}  # (policy, workload, util) -> list[(size,fct)]
+    dropped = live = 0
     for fn in glob.glob(os.path.join(LOG_DIR, "*.log")):
-        base = os.path.basename(fn).lower()
-        policy = "conga" if "conga" in base else "ecmp"
-        workload = next((w for w in ["uniform","pareto","enterprise","datamining"] if w in base), "unknown")
-        m = re.search(r'u([0-9.]+)', base)
-        if m:
-            # strip trailing dots or underscores just in case
-            val = m.group(1).rstrip(".")
-            try:
-                util = float(val)
-            except ValueError:
-                util = 0.0
+        base = os.path.basename(fn)
+        t = TAG_RE.match(base)
+        if t:
+            policy, workload = t.group("policy").lower(), t.group("workload")
+            util = float(t.group("util"))
         else:
-            util = 0.0
+            base = base.lower()
+            policy = "conga" if "conga" in base else "ecmp"
+            workload = next((w for w in ["uniform","pareto","enterprise","datamining"] if w in base), "unknown")
+            m = re.search(r'u([0-9.]+)', base)
+            if m:
+                # strip trailing dots or underscores just in case
+                val = m.group(1).rstrip(".")
+                try:
+                    util = float(val)
+                except ValueError:
+                    util = 0.0
+            else:
+                util = 0.0
         key = (policy, workload, util)
         data.setdefault(key, [])
+        flows, warmup = [], 0
         with open(fn) as f:
             for line in f:
                 m = FLOW_RE.search(line)
                 if m:
-                    size = int(m.group("size"))
-                    fct = float(m.group("fct"))
-                    data[key].append((size, fct))
-    print(f"Parsed {sum(len(v) for v in data.values())} flows from {LOG_DIR}")
+                    flows.append((int(m.group("start")), int(m.group("size")), float(m.group("fct"))))
+                    continue
+                m = WARMUP_RE.match(line)
+                if m:
+                    warmup = int(m.group("warmup"))
+                    continue
+                m = LIVE_RE.match(line)
+                if m:
+                    live += int(m.group("n"))
+        kept = [(size, fct) for start, size, fct in flows if start >= warmup]
+        dropped += len(flows) - len(kept)
+        data[key].extend(kept)
+    print(f"Parsed {sum(len(v) for v in data.values())} flows from {LOG_DIR}"
+          f" ({dropped} in warm-up dropped, {live} unfinished at the end not counted)")
     return data
 
 def mean_fct(flows, sel):
@@ -71,6 +95,6 @@ def plot_workload(data, workload):
         print(f"Saved {fname}")
 
 data = parse_logs()
-for w in ["uniform","pareto","enterprise","datamining"]:
+for w in sorted({w for (_,w,_) in data.keys()}):
     plot_workload(data, w)
 print(f"Plots saved in {PLOT_DIR}")
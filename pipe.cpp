@@ -3,12 +3,18 @@
 using namespace std;
 
 Pipe::Pipe(simtime_picosec delay)
-    : EventSource("pipe"), _delay(delay)
+    : EventSource("pipe"), _delay(delay), _failed(false)
 {}
 
 void
 Pipe::receivePacket(Packet &pkt)
 {
+    if (_failed) {
+        pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_DROP);
+        pkt.free();
+        return;
+    }
+
     pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_ARRIVE);
 
     if (_inflight.empty()) {
@@ -19,8 +19,13 @@ class Pipe : public EventSource, public PacketSink
         void doNextEvent(); // inherited from EventSource
         simtime_picosec delay() { return _delay; }
 
+        // A failed pipe drops every packet sent into it (a black hole).
+        void setFailed(bool failed) { _failed = failed; }
+        bool failed() { return _failed; }
+
     private:
         simtime_picosec _delay;
+        bool _failed;
         typedef std::pair<simtime_picosec,Packet *> pktrecord_t;
         std::deque<pktrecord_t> _inflight; // the packets in flight (or being serialized)
 };
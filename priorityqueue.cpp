@@ -6,7 +6,7 @@
 using namespace std;
 
 PriorityQueue::PriorityQueue(linkspeed_bps bitrate, mem_b maxsize, QueueLogger *logger)
-    : Queue(bitrate, maxsize, logger)
+    : Queue(bitrate, maxsize, logger), _currentPkt(NULL)
 {
 }
 
@@ -44,6 +44,7 @@ PriorityQueue::completeService()
     }
 
     applyEcnMark(*_currentPkt);
+    addTelemetry(*_currentPkt);
     _currentPkt->sendOn();
 
     // Clear packet being transmitted.
@@ -14,11 +14,19 @@ Queue::Queue(linkspeed_bps bitrate,
              _maxsize(maxsize), 
              _queuesize(0),
              _bitrate(bitrate), 
+             _txBytes(0),
              _logger(logger)
 {
     _ps_per_byte = (simtime_picosec)(8 * 1000000000000UL / _bitrate);
 }
 
+void
+Queue::setBitrate(linkspeed_bps bitrate)
+{
+    _bitrate = bitrate;
+    _ps_per_byte = (simtime_picosec)(8 * 1000000000000UL / _bitrate);
+}
+
 void
 Queue::beginService()
 {
@@ -42,6 +50,7 @@ Queue::completeService()
     }
 
     applyEcnMark(*pkt);
+    addTelemetry(*pkt);
     pkt->sendOn();
 
     if (!_enqueued.empty()) {
@@ -99,6 +108,21 @@ Queue::applyEcnMark(Packet &pkt)
     }
 }
 
+void
+Queue::addTelemetry(Packet &pkt)
+{
+    _txBytes += pkt.size();
+
+    if (pkt.getFlag(Packet::INT)) {
+        IntHop hop;
+        hop.qlen = _queuesize;
+        hop.txBytes = _txBytes;
+        hop.ts = EventList::Get().now();
+        hop.rate = _bitrate;
+        ((DataPacket&)pkt).pushHop(hop);
+    }
+}
+
 void
 Queue::printStats()
 {
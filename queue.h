@@ -10,7 +10,7 @@
 
 #include <list>
 
-class Queue : public EventSource, public PacketSink
+class Queue : public EventSource, public PacketSink, public Pooled<Queue>
 {
     public:
         Queue(linkspeed_bps bitrate, mem_b maxsize, QueueLogger *logger);
@@ -18,6 +18,14 @@ class Queue : public EventSource, public PacketSink
         virtual void receivePacket(Packet &pkt);
         virtual void printStats();
 
+        // Change the drain rate, e.g. to model a degraded link. The packet
+        // in service keeps its departure time.
+        void setBitrate(linkspeed_bps bitrate);
+        inline linkspeed_bps bitrate() const {return _bitrate;}
+
+        // Bytes sent since the queue was created.
+        inline uint64_t txBytes() const {return _txBytes;}
+
         inline simtime_picosec drainTime(Packet *pkt) {
             return (simtime_picosec)(pkt->size()) * _ps_per_byte;
         }
@@ -49,9 +57,14 @@ class Queue : public EventSource, public PacketSink
         // Apply ECN marking.
         void applyEcnMark(Packet &pkt);
 
+        // Count a departing packet and record this queue's telemetry on
+        // it if it asks for it.
+        void addTelemetry(Packet &pkt);
+
         std::list<Packet*> _enqueued;  // List of packet enqueued.
         linkspeed_bps _bitrate;       // Speed at which queue drains.
         simtime_picosec _ps_per_byte; // Service time, in picosec per byte.
+        uint64_t _txBytes;            // Bytes sent, for link utilization.
 
         // Housekeeping
         QueueLogger *_logger;
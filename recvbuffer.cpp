@@ -0,0 +1,156 @@
+/*
+ * Receive buffer
+ */
+#include "recvbuffer.h"
+
+using namespace std;
+
+#define RECVBUF_MIN_SLOTS 64
+
+ReceiveBuffer::ReceiveBuffer()
+                            : _cumulative_ack(0),
+                            _nSegments(0),
+                            _nSlots(0)
+{
+    // The ring is allocated on the first out-of-order segment.
+}
+
+bool
+ReceiveBuffer::insert(seq_t seqno,
+                      mem_b size)
+{
+    if (seqno <= _cumulative_ack) {
+        // Must have been a bad retransmit, do nothing.
+        return false;
+    }
+
+    if (seqno == _cumulative_ack + 1) {
+        // It's the next expected sequence number.
+        _cumulative_ack += size;
+        if (_nSegments > 0) {
+            advance();
+        }
+        return true;
+    }
+
+    // It's not the next expected sequence number, buffer it.
+    uint64_t head = _cumulative_ack / MSS_BYTES;
+    uint64_t idx = (seqno - 1) / MSS_BYTES;
+
+    if (idx <= head) {
+        // Overlaps the next expected segment, can't be placed.
+        return false;
+    }
+
+    if (idx - head >= _nSlots) {
+        grow(idx - head + 1);
+    }
+
+    uint64_t s = slot(idx);
+    if (test(s)) {
+        // Probably a bad retransmit.
+        return false;
+    }
+
+    set(s);
+    _sizes[s] = size;
+    _nSegments++;
+    return true;
+}
+
+void
+ReceiveBuffer::advance()
+{
+    while (_nSegments > 0) {
+        uint64_t s = slot(_cumulative_ack / MSS_BYTES);
+        if (!test(s)) {
+            break;
+        }
+        clear(s);
+        _cumulative_ack += _sizes[s];
+        _nSegments--;
+    }
+}
+
+void
+ReceiveBuffer::grow(uint64_t nslots)
+{
+    uint64_t newSlots = max((uint64_t)RECVBUF_MIN_SLOTS, _nSlots);
+    while (newSlots < nslots) {
+        newSlots *= 2;
+    }
+
+    vector<uint64_t> bits(newSlots / 64, 0);
+    vector<mem_b> sizes(newSlots, 0);
+
+    // Re-home buffered segments, the ring starts at the next expected one.
+    uint64_t head = _cumulative_ack / MSS_BYTES;
+    for (uint64_t idx = head; _nSegments > 0 && idx < head + _nSlots; idx++) {
+        uint64_t s = slot(idx);
+        if (test(s)) {
+            uint64_t t = idx & (newSlots - 1);
+            bits[t >> 6] |= (1ULL << (t & 63));
+            sizes[t] = _sizes[s];
+        }
+    }
+
+    _bits.swap(bits);
+    _sizes.swap(sizes);
+    _nSlots = newSlots;
+}
+
+SackBlock
+ReceiveBuffer::blockAt(uint64_t idx) const
+{
+    uint64_t head = _cumulative_ack / MSS_BYTES;
+    uint64_t first = idx, last = idx;
+
+    while (first - 1 > head && test(slot(first - 1))) {
+        first--;
+    }
+    while (last + 1 < head + _nSlots && test(slot(last + 1))) {
+        last++;
+    }
+
+    SackBlock b;
+    b.start = first * MSS_BYTES + 1;
+    b.end = last * MSS_BYTES + 1 + _sizes[slot(last)];
+    return b;
+}
+
+uint32_t
+ReceiveBuffer::sackBlocks(SackBlock *blocks,
+                          uint32_t max,
+                          seq_t recent) const
+{
+    if (_nSegments == 0 || max == 0) {
+        return 0;
+    }
+
+    uint64_t head = _cumulative_ack / MSS_BYTES;
+    uint64_t recentIdx = (recent - 1) / MSS_BYTES;
+    uint32_t n = 0;
+
+    if (recentIdx > head && recentIdx - head < _nSlots && test(slot(recentIdx))) {
+        blocks[n++] = blockAt(recentIdx);
+    }
+
+    // Walk the buffered segments from the cumulative ack up.
+    uint32_t seen = 0;
+    for (uint64_t idx = head + 1; n < max && seen < _nSegments && idx < head + _nSlots; idx++) {
+        if (!test(slot(idx))) {
+            continue;
+        }
+
+        SackBlock b = blockAt(idx);
+        uint64_t last = (b.end - 2) / MSS_BYTES;
+        seen += last - idx + 1;
+
+        if (n == 0 || b.start != blocks[0].start) {
+            blocks[n++] = b;
+        }
+        idx = last;
+    }
+
+    return n;
+}
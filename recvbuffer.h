@@ -0,0 +1,74 @@
+/*
+ * Receive buffer header
+ */
+#ifndef RECVBUFFER_H
+#define RECVBUFFER_H
+
+#include "htsim.h"
+
+#include <vector>
+
+#define MAX_SACK_BLOCKS 3
+
+// A run of contiguous data held by the receiver: sequence numbers [start, end).
+struct SackBlock
+{
+    uint64_t start;
+    uint64_t end;
+};
+
+/*
+ * Reassembly buffer for out-of-order segments at the receiver.
+ *
+ * Segments are tracked in a bitmap keyed by MSS index (seqno / MSS_BYTES),
+ * laid out as a ring that starts at the next expected segment. Inserting a
+ * segment and advancing the cumulative ack are both O(1) amortized, which
+ * keeps reassembly cheap when per-packet load balancing reorders a whole
+ * window. Sequence numbers are byte based and start at 1, as in DataPacket.
+ */
+class ReceiveBuffer
+{
+    public:
+        typedef uint64_t seq_t;
+
+        ReceiveBuffer();
+
+        // Records a received segment. Returns false if it was a duplicate.
+        bool insert(seq_t seqno, mem_b size);
+
+        // Last in-order byte received.
+        inline seq_t cumulativeAck() const {return _cumulative_ack;}
+
+        // Number of segments held beyond the cumulative ack.
+        inline uint32_t size() const {return _nSegments;}
+        inline bool empty() const {return _nSegments == 0;}
+
+        // Fills blocks with up to max SACK blocks and returns how many. As in
+        // RFC 2018 the first block holds the segment starting at recent, the
+        // rest are the lowest other blocks above the cumulative ack.
+        uint32_t sackBlocks(SackBlock *blocks, uint32_t max, seq_t recent) const;
+
+    private:
+        // Moves the cumulative ack past any contiguous buffered segments.
+        void advance();
+
+        // Grows the ring so that it can hold at least nslots segments.
+        void grow(uint64_t nslots);
+
+        // Block of buffered segments around segment index idx.
+        SackBlock blockAt(uint64_t idx) const;
+
+        inline uint64_t slot(uint64_t idx) const {return idx & (_nSlots - 1);}
+        inline bool test(uint64_t s) const {return (_bits[s >> 6] >> (s & 63)) & 1;}
+        inline void set(uint64_t s) {_bits[s >> 6] |= (1ULL << (s & 63));}
+        inline void clear(uint64_t s) {_bits[s >> 6] &= ~(1ULL << (s & 63));}
+
+        seq_t _cumulative_ack;       // Last in-order byte.
+        uint32_t _nSegments;         // Buffered out-of-order segments.
+
+        uint64_t _nSlots;            // Ring capacity in segments (power of two).
+        std::vector<uint64_t> _bits; // Occupancy bitmap, one bit per segment.
+        std::vector<mem_b> _sizes;   // Size of each buffered segment.
+};
+
+#endif /* RECVBUFFER_H */
@@ -2,7 +2,8 @@
 set -euo pipefail
 
 # Parameters you may tweak
-DUR=${DUR:-30}            # simulation duration (seconds)
+DUR=${DUR:-30}            # simulation duration (seconds), at most
+CONVERGE=${CONVERGE:-0}   # stop once FCT/utilization CIs are within this of the mean (0 = run DUR)
 FLOWSZ=${FLOWSZ:-131072}  # average flow size in bytes (128KB)
 QUEUE=${QUEUE:-droptail}
 ENDH=${ENDH:-tcp}
@@ -17,22 +18,24 @@ workloads=(uniform pareto enterprise datamining)
 loads=(0.1 0.2 0.3 0.4 0.5 0.6 0.7 0.8 0.9 1.0)
 policies=(ecmp conga)
 
-# If your tree doesn’t implement enterprise, it will be mapped to pareto in test_conga_testbed.cpp.
-# You can still pass --flowdist=enterprise for naming consistency.
+# Any entry may also be the path of a flow size CDF file ("size probability" per line),
+# tagged in log names by its file name without the extension.
 
 run_one () {
   local policy="$1"
   local work="$2"
   local util="$3"
-  local tag="${policy}_${work}_U${util}"
+  local name
+  name="$(basename "${work}")"
+  local tag="${policy}_${name%.*}_U${util}"
   local log="${OUTDIR}/${tag}.log"
 
   echo "Running ${tag}..."
-  "${BIN}" --expt=${EXPT}            --duration=${DUR}            --utilization=${util}            --flowsize=${FLOWSZ}            --queue=${QUEUE}            --endhost=${ENDH}            --flowdist=${work}            --policy=${policy} > "${log}"
+  "${BIN}" --expt=${EXPT}            --duration=${DUR}            --utilization=${util}            --flowsize=${FLOWSZ}            --queue=${QUEUE}            --endhost=${ENDH}            --flowdist=${work}            --policy=${policy}            --converge=${CONVERGE} > "${log}"
 }
 
 export -f run_one
-export BIN EXPT DUR FLOWSZ QUEUE ENDH OUTDIR
+export BIN EXPT DUR CONVERGE FLOWSZ QUEUE ENDH OUTDIR
 
 # Sequential fallback (portable)
 if [ "${PARALLEL_JOBS}" -le 1 ]; then
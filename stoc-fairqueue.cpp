@@ -67,6 +67,7 @@ StocFairQueue::completeService()
     }
 
     applyEcnMark(*pkt);
+    addTelemetry(*pkt);
     pkt->sendOn();
 
     beginService();
@@ -9,7 +9,6 @@
 
 using namespace std;
 
-bool TcpSrc::_enable_dctcp = false;
 map<uint64_t, uint64_t> TcpSrc::slacks;
 map<uint64_t, uint64_t> TcpSink::slacks;
 uint64_t TcpSrc::totalPkts = 0;
@@ -20,6 +19,7 @@ TcpSrc::TcpSrc(TcpLogger *logger,
                uint32_t flowsize,
                simtime_picosec duration)
               :DataSource(pktlogger, flowsize, duration),
+               _cc(CC_NEWRENO),
                _state(IDLE),
                _ssthresh(0xffffffff),
                _cwnd(0),
@@ -29,16 +29,90 @@ TcpSrc::TcpSrc(TcpLogger *logger,
                _rtt(0),
                _rto(timeFromUs(INIT_RTO_US)),
                _mdev(0),
+               _min_rtt(0),
                _RFC2988_RTO_timeout(0),
+               _reorder_tolerant(false),
+               _sack(false),
                _alpha(0.0),
                _marked_pkts(0),
                _total_pkts(0),
                _dctcp_cwnd(0),
+               _cubic_wmax(0),
+               _cubic_epoch(0),
+               _cubic_k(0),
+               _cubic_origin(0),
+               _cubic_west(0),
+               _sk(NULL),
+               _ro(NULL),
+               _msgs(NULL),
+               _pacer(NULL),
+               _pace_quantum(0),
+               _pace_burst(0),
+               _pace_next(0),
+               _pace_pending(false),
                _logger(logger)
 {
     // Constructor
 }
 
+TcpSrc::~TcpSrc()
+{
+    delete _sk;
+    delete _ro;
+    delete _msgs;
+}
+
+void
+TcpSrc::setPersistent(MessageHandler handler,
+                      bool onAck)
+{
+    _msgs = new Messages();
+    _msgs->handler = handler;
+    _msgs->onAck = onAck;
+}
+
+void
+TcpSrc::sendMessage(uint64_t bytes,
+                    uint64_t tag)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    _flowsize = (_flowsize + MSS_BYTES - 1) / MSS_BYTES * MSS_BYTES + bytes;
+    _msgs->queue.push_back(Message{_flowsize, tag});
+
+    // Not started yet: the first event sends, and is scheduled unless the
+    // connection was waiting for its first message.
+    if (_state == IDLE) {
+        if (_wakeup_at == 0) {
+            _wakeup_at = current_ts;
+            EventList::Get().sourceIsPending(*this, _wakeup_at);
+        }
+        return;
+    }
+
+    // Restart the retransmission timer and periodic checks after an idle
+    // spell (RFC 2988 5.1).
+    if (_RFC2988_RTO_timeout == 0) {
+        _RFC2988_RTO_timeout = current_ts + _rto;
+    }
+    sendPackets();
+
+    if (_wakeup_at == 0) {
+        _wakeup_at = current_ts + (_rtt != 0 ? _rtt : timeFromUs(MIN_RTO_US));
+        EventList::Get().sourceIsPending(*this, _wakeup_at);
+    }
+}
+
+void
+TcpSrc::messagesDone(uint64_t ackno)
+{
+    while (!_msgs->queue.empty() && _msgs->queue.front().end <= ackno) {
+        uint64_t tag = _msgs->queue.front().tag;
+        _msgs->queue.pop_front();
+        _msgs->handler(tag);
+    }
+}
+
 void
 TcpSrc::printStatus()
 {
@@ -66,26 +140,35 @@ void
 TcpSrc::doNextEvent()
 {
     simtime_picosec current_ts = EventList::Get().now();
+    _wakeup_at = 0;
 
     // This is a new flow, start sending packets.
     if (_state == IDLE) {
+        if (_msgs != NULL && _msgs->queue.empty()) {
+            return;
+        }
         _state = SLOW_START;
         _cwnd = 2 * MSS_BYTES;
         _dctcp_cwnd = _cwnd;
+        if (_sack) {
+            _sk = new SackState(*this);
+        } else if (_reorder_tolerant) {
+            _ro = new ReorderState(*this);
+        }
         sendPackets();
     }
 
     // Cleanup the finished flow.
     else if (_state == FINISH) {
-        // If no more flow packets in the system, delete all objects.
-        // Make sure no one else has access to these.
-        if (_flow._nPackets == 0) {
-            delete _sink;
-            delete _route_fwd;
-            delete _route_rev;
-            delete this;
+        if (drained()) {
+            release();
             return;
         }
+
+        // No more periodic checks: the last packet or timer of the flow
+        // to go wakes us up again.
+        _flow.setWaiter(this);
+        return;
     }
 
     // Retransmission timeout.
@@ -107,27 +190,44 @@ TcpSrc::doNextEvent()
             _cwnd = min(_ssthresh, flightsize + MSS_BYTES);
         }
 
-        _ssthresh = max(_cwnd / 2, (uint32_t)(MSS_BYTES * 2));
+        reduceWindow();
 
         _cwnd = MSS_BYTES;
         _state = SLOW_START;
         _recover_seq = _highest_sent;
-        _highest_sent = _last_acked + MSS_BYTES;
         _dupacks = 0;
 
         // Reset rtx timerRFC 2988 5.5 & 5.6
         _rto *= 2;
         _RFC2988_RTO_timeout = current_ts + _rto;
 
-        retransmitPacket(1);
+        refreshRoutes();
+
+        if (_sack) {
+            sackTimeout();
+        } else {
+            _highest_sent = _last_acked + MSS_BYTES;
+            retransmitPacket(1);
+        }
     }
 
-    // Schedule periodic RTT checks.
-    if (_rtt != 0) {
-        EventList::Get().sourceIsPendingRel(*this, _rtt);
-    } else {
-        EventList::Get().sourceIsPendingRel(*this, timeFromUs(MIN_RTO_US));
+    // A persistent connection with everything acknowledged waits for its
+    // next message instead.
+    if (_msgs != NULL && idle()) {
+        return;
     }
+
+    // Schedule periodic RTT checks.
+    _wakeup_at = current_ts + (_rtt != 0 ? _rtt : timeFromUs(MIN_RTO_US));
+    EventList::Get().sourceIsPending(*this, _wakeup_at);
+}
+
+bool
+TcpSrc::drained()
+{
+    return _flow._nPackets == 0 && (_sk == NULL || _sk->timer_events == 0)
+        && (_ro == NULL || _ro->timer_events == 0) && !_pace_pending
+        && !((TcpSink*)_sink)->timerPending();
 }
 
 void
@@ -138,6 +238,10 @@ TcpSrc::receivePacket(Packet &pkt)
     DataAck::seq_t seqno = p->ackno();
     simtime_picosec ts = p->ts();
 
+    SackBlock sack[MAX_SACK_BLOCKS];
+    uint32_t nsack = p->nSack();
+    copy(p->sackBlocks(), p->sackBlocks() + nsack, sack);
+
     pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
     p->free();
 
@@ -145,8 +249,8 @@ TcpSrc::receivePacket(Packet &pkt)
         return;
     }
 
-    if ((_flowsize > 0 && seqno >= _flowsize) ||
-            (_duration > 0 && current_ts > _start_time + _duration)) {
+    if (_msgs == NULL && ((_flowsize > 0 && seqno >= _flowsize) ||
+            (_duration > 0 && current_ts > _start_time + _duration))) {
 
         if (_flowgen != NULL) {
             _flowgen->finishFlow(id);
@@ -163,6 +267,11 @@ TcpSrc::receivePacket(Packet &pkt)
              << " cwnd " << _cwnd
              << " alpha " << _alpha << endl;
 
+        // Usually the last ack leaves nothing behind, so free the flow now
+        // rather than on its next timer.
+        if (drained()) {
+            release();
+        }
         return;
     }
 
@@ -172,6 +281,10 @@ TcpSrc::receivePacket(Packet &pkt)
         return;
     }
 
+    if (_msgs != NULL && _msgs->onAck) {
+        messagesDone(seqno);
+    }
+
     if (TRACE_FLOW == str()) {
         // cout << str() << " RECV " << EventList::Get().now() << " " << seqno << endl;
     }
@@ -180,6 +293,10 @@ TcpSrc::receivePacket(Packet &pkt)
     uint64_t m = current_ts - ts;
 
     if (m > 0) {
+        if (_min_rtt == 0 || m < _min_rtt) {
+            _min_rtt = m;
+        }
+
         if (_rtt > 0) {
             uint64_t abs;
             if (m > _rtt)
@@ -200,10 +317,16 @@ TcpSrc::receivePacket(Packet &pkt)
         }
     }
 
-    if (_enable_dctcp) {
+    // Segments covered by this ack, more than one for stretch acks.
+    uint32_t acked = 1;
+    if (seqno > _last_acked + MSS_BYTES) {
+        acked = (seqno - _last_acked) / MSS_BYTES;
+    }
+
+    if (_cc == CC_DCTCP) {
         // Update ECN counters.
         if (pkt.getFlag(Packet::ECN_REV)) {
-            _marked_pkts += 1;
+            _marked_pkts += acked;
 
             // If in slow_start, exit and update _sshthresh.
             if (_state == SLOW_START && _ssthresh > _cwnd) {
@@ -211,7 +334,7 @@ TcpSrc::receivePacket(Packet &pkt)
                 _ssthresh = _cwnd;
             }
         }
-        _total_pkts += 1;
+        _total_pkts += acked;
 
         // Update _alpha and _cwnd, roughly once per cwnd of data.
         if (_total_pkts * MSS_BYTES > _dctcp_cwnd) {
@@ -236,9 +359,21 @@ TcpSrc::receivePacket(Packet &pkt)
         }
     }
 
+    if (_sack) {
+        sackReceive(seqno, sack, nsack);
+        return;
+    }
+
     // Brand new ack.
     if (seqno > _last_acked) {
 
+        // The hole, if any, is filled.
+        if (_ro != NULL) {
+            uint64_t n = min((seqno - _last_acked) / MSS_BYTES, (uint64_t)_ro->xmit_ts.size());
+            _ro->xmit_ts.erase(_ro->xmit_ts.begin(), _ro->xmit_ts.begin() + n);
+            _ro->deadline = 0;
+        }
+
         // RFC 2988 5.3
         _RFC2988_RTO_timeout = current_ts + _rto;
 
@@ -249,9 +384,10 @@ TcpSrc::receivePacket(Packet &pkt)
 
         // Best behaviour: proper ack of a new packet, when we were expecting it.
         if (_state != FAST_RECOV) { // _state == SLOW_START || CONG_AVOID
+            uint32_t new_data = seqno - _last_acked;
             _last_acked = seqno;
             _dupacks = 0;
-            inflateWindow();
+            inflateWindow(new_data);
 
             if (_logger) _logger->logTcp(*this, TcpLogger::TCP_RCV);
             sendPackets();
@@ -306,23 +442,41 @@ TcpSrc::receivePacket(Packet &pkt)
     // Not yet in fast recovery. Wait for more dupacks.
     _dupacks++;
 
-    if (_dupacks != 3) {
+    bool dupthresh = (_dupacks == 3);
+    if (_ro != NULL && !_ro->xmit_ts.empty()) {
+        // Treat the hole as reordering until it has been out for the min
+        // RTT plus a quarter of it, and check again then if no more
+        // dupacks come by.
+        _ro->deadline = _ro->xmit_ts.front() + _min_rtt + _min_rtt / 4;
+        dupthresh = (_dupacks >= 3 && current_ts >= _ro->deadline);
+        if (_dupacks >= 3 && !dupthresh) {
+            armReorderTimer();
+        }
+    }
+
+    if (!dupthresh) {
         if (_logger) _logger->logTcp(*this, TcpLogger::TCP_RCV_DUP);
         sendPackets();
         return;
     }
 
-    // _dupacks == 3
+    // _dupacks == 3 (or the reordering window expired)
     if (_last_acked < _recover_seq) {
         // See RFC 3782: if we haven't recovered from timeouts etc. don't do fast recovery.
         if (_logger) _logger->logTcp(*this, TcpLogger::TCP_RCV_3DUPNOFR);
         return;
     }
 
+    fastRetransmit();
+}
+
+void
+TcpSrc::fastRetransmit()
+{
     // Begin fast retransmit/recovery. (count drops only in CA state)
     _drops++;
 
-    _ssthresh = max(_cwnd / 2, (uint32_t)(MSS_BYTES * 2));
+    reduceWindow();
     _cwnd = _ssthresh + 3 * MSS_BYTES;
     _state = FAST_RECOV;
 
@@ -334,22 +488,26 @@ TcpSrc::receivePacket(Packet &pkt)
 }
 
 void
-TcpSrc::inflateWindow()
+TcpSrc::inflateWindow(uint32_t acked)
 {
     // Be very conservative - possibly not the best we can do, but
-    // the alternative has bad side effects.
-    int newly_acked = (_last_acked + _cwnd) - _highest_sent;
+    // the alternative has bad side effects. Stretch acks (delayed acks)
+    // grow the window by the data they cover, not by one segment. With
+    // SACK the pipe, not _highest_sent, tracks what is in flight.
+    int newly_acked = _sack ? (int)acked : (int)((_last_acked + _cwnd) - _highest_sent);
     int increment;
 
     if (newly_acked < 0) {
         return;
-    } else if (newly_acked > MSS_BYTES) {
-        newly_acked = MSS_BYTES;
+    } else if (newly_acked > (int)max(acked, (uint32_t)MSS_BYTES)) {
+        newly_acked = max(acked, (uint32_t)MSS_BYTES);
     }
 
     if (_cwnd < _ssthresh) {
         // Slow start phase.
         increment = min(_ssthresh - _cwnd, (uint32_t)newly_acked);
+    } else if (_cc == CC_CUBIC) {
+        increment = cubicIncrement(newly_acked);
     } else {
         // Congestion avoidance phase.
         increment = (newly_acked * MSS_BYTES) / _cwnd;
@@ -360,10 +518,70 @@ TcpSrc::inflateWindow()
     _cwnd += increment;
 }
 
+uint32_t
+TcpSrc::cubicIncrement(uint32_t acked)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    // First ack of a new epoch: find how long the cubic takes to regrow
+    // from here to the window at the last reduction.
+    if (_cubic_epoch == 0) {
+        _cubic_epoch = current_ts;
+        if (_cwnd < _cubic_wmax) {
+            _cubic_k = cbrt((double)(_cubic_wmax - _cwnd) / MSS_BYTES / CUBIC_C);
+            _cubic_origin = _cubic_wmax;
+        } else {
+            _cubic_k = 0;
+            _cubic_origin = _cwnd;
+        }
+        _cubic_west = _cwnd;
+    }
+
+    // Target window one min RTT from now (RFC 8312 4.1).
+    double t = timeAsSec(current_ts - _cubic_epoch + _min_rtt) - _cubic_k;
+    double target = _cubic_origin + CUBIC_C * t * t * t * MSS_BYTES;
+
+    // At most 1.5x per RTT (RFC 8312 4.1), and never slower than Reno
+    // would grow (RFC 8312 4.2).
+    target = min(target, 1.5 * _cwnd);
+    _cubic_west += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked * MSS_BYTES / _cwnd;
+    if (target < _cubic_west) {
+        target = _cubic_west;
+    }
+
+    // Close a 1/cwnd share of the gap on each acked segment.
+    uint32_t increment = 1;
+    if (target > _cwnd) {
+        increment = max((uint32_t)((target - _cwnd) * acked / _cwnd), 1u);
+    }
+    return increment;
+}
+
+void
+TcpSrc::reduceWindow()
+{
+    if (_cc != CC_CUBIC) {
+        _ssthresh = max(_cwnd / 2, (uint32_t)(MSS_BYTES * 2));
+        return;
+    }
+
+    // Fast convergence: release bandwidth to newer flows (RFC 8312 4.6).
+    if (_cwnd < _cubic_wmax) {
+        _cubic_wmax = _cwnd * (1 + CUBIC_BETA) / 2;
+    } else {
+        _cubic_wmax = _cwnd;
+    }
+    _cubic_epoch = 0;
+    _ssthresh = max((uint32_t)(_cwnd * CUBIC_BETA), (uint32_t)(MSS_BYTES * 2));
+}
+
 void
 TcpSrc::sendPackets()
 {
-    simtime_picosec current_ts = EventList::Get().now();
+    if (_sack) {
+        sendSackPackets();
+        return;
+    }
 
     // Already sent out enough bytes.
     if (_flowsize > 0 && _highest_sent >= _flowsize) {
@@ -375,48 +593,12 @@ TcpSrc::sendPackets()
     }
 
     while (_last_acked + _cwnd >= _highest_sent + MSS_BYTES) {
-        DataPacket *p = DataPacket::newpkt(_flow, *_route_fwd, _highest_sent + 1, MSS_BYTES);
-
-        p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
-        p->set_ts(current_ts);
-
-        // pFabric priority.
-        //if (ENABLE_PFABRIC) {
-        //    p->setPriority(_flowsize);
-        //}
-
-        if (_enable_deadline) {
-            // Calculate and set deadline for this packet.
-            simtime_picosec timeRemaining;
-            //if (_deadline - timeFromUs(8) > current_ts) {
-            if (_deadline > current_ts) {
-                timeRemaining = _deadline - current_ts;
-            } else {
-                timeRemaining = 0;
-            }
-
-            uint64_t packetsRemaining = (_flowsize - _highest_sent) / MSS_BYTES + 1;
-            uint64_t slack = (timeRemaining / packetsRemaining);
-            uint64_t hist = slack/1000000;
-
-            if (slacks.find(hist) == slacks.end()) {
-                slacks[hist] = 1;
-            } else {
-                slacks[hist] += 1;
-            }
-            totalPkts += 1;
-
-            p->setFlag(Packet::DEADLINE);
-            p->setPriority(llround(timeAsNs(slack)));
+        if (_pacer != NULL && paceHold()) {
+            break;
         }
 
+        sendSegment(_highest_sent + 1, false);
         _highest_sent += MSS_BYTES;
-        _packets_sent += MSS_BYTES;
-        p->sendOn();
-
-        if (_RFC2988_RTO_timeout == 0) { // RFC2988 5.1
-            _RFC2988_RTO_timeout = current_ts + _rto;
-        }
 
         if (_flowsize > 0 && _highest_sent >= _flowsize) {
             break;
@@ -431,36 +613,492 @@ TcpSrc::retransmitPacket(int reason)
         // cout << str() << " RETX " << EventList::Get().now() << " " << reason << endl;
     }
 
-    DataPacket *p = DataPacket::newpkt(_flow, *_route_fwd, _last_acked + 1, MSS_BYTES);
+    sendSegment(_last_acked + 1, true);
+}
+
+void
+TcpSrc::sendSegment(uint64_t seqno,
+                    bool retransmit)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    if (_ro != NULL) {
+        uint64_t idx = (seqno - 1 - _last_acked) / MSS_BYTES;
+        if (idx < _ro->xmit_ts.size()) {
+            _ro->xmit_ts[idx] = current_ts;
+        } else {
+            _ro->xmit_ts.push_back(current_ts);
+        }
+    }
+
+    DataPacket *p = DataPacket::newpkt(_flow, _route_fwd, seqno, MSS_BYTES);
     p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
-    p->set_ts(EventList::Get().now());
+    p->set_ts(current_ts);
 
     // pFabric priority.
     //if (ENABLE_PFABRIC) {
     //    p->setPriority(_flowsize);
     //}
 
-    if (_enable_deadline) {
+    if (_enable_deadline && retransmit) {
         p->setFlag(Packet::DEADLINE);
         p->setPriority(0);
+    } else if (_enable_deadline) {
+        // Calculate and set deadline for this packet.
+        simtime_picosec timeRemaining;
+        //if (_deadline - timeFromUs(8) > current_ts) {
+        if (_deadline > current_ts) {
+            timeRemaining = _deadline - current_ts;
+        } else {
+            timeRemaining = 0;
+        }
+
+        uint64_t packetsRemaining = (_flowsize - (seqno - 1)) / MSS_BYTES + 1;
+        uint64_t slack = (timeRemaining / packetsRemaining);
+        uint64_t hist = slack/1000000;
+
+        if (slacks.find(hist) == slacks.end()) {
+            slacks[hist] = 1;
+        } else {
+            slacks[hist] += 1;
+        }
+        totalPkts += 1;
+
+        p->setFlag(Packet::DEADLINE);
+        p->setPriority(llround(timeAsNs(slack)));
     }
 
     _packets_sent += MSS_BYTES;
     p->sendOn();
 
-    if(_RFC2988_RTO_timeout == 0) { // RFC2988 5.1
-        _RFC2988_RTO_timeout = EventList::Get().now() + _rto;
+    if (_RFC2988_RTO_timeout == 0) { // RFC2988 5.1
+        _RFC2988_RTO_timeout = current_ts + _rto;
+    }
+
+    if (_pace_burst > 0) {
+        _pace_burst--;
     }
 }
 
+void
+TcpSrc::setPacing(uint32_t quantum,
+                  HostPacer &pacer)
+{
+    _pacer = &pacer;
+    _pace_quantum = max(quantum, 1u);
+}
+
+bool
+TcpSrc::paceHold()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    // No rate to pace at before the first RTT sample.
+    if (_pace_burst > 0 || _rtt == 0) {
+        return false;
+    }
+
+    if (current_ts < _pace_next) {
+        if (!_pace_pending) {
+            _pace_pending = true;
+            _pacer->schedule(*this, _pace_next);
+        }
+        return true;
+    }
+
+    // Start a burst, and space the next one at the pacing rate. The pacer
+    // may release us a little late, so keep to the ideal schedule unless
+    // we fell a whole gap behind it.
+    double gain = (_cwnd < _ssthresh) ? 2.0 : 1.2;
+    simtime_picosec gap = max(llround((double)_pace_quantum * MSS_BYTES * _rtt / (gain * _cwnd)), 1LL);
+    if (_pace_next + gap > current_ts) {
+        _pace_next += gap;
+    } else {
+        _pace_next = current_ts + gap;
+    }
+    _pace_burst = _pace_quantum;
+    return false;
+}
 
-TcpSink::TcpSink() : DataSink() {}
+void
+TcpSrc::pacedSend()
+{
+    _pace_pending = false;
+    if (_state != FINISH) {
+        sendPackets();
+    } else {
+        _flow.wake();
+    }
+}
+
+void
+TcpSrc::sackReceive(uint64_t seqno,
+                    const SackBlock *blocks,
+                    uint32_t nblocks)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    // Cumulative ack.
+    if (seqno > _last_acked) {
+
+        // RFC 2988 5.3 & 5.2
+        _RFC2988_RTO_timeout = current_ts + _rto;
+        if (seqno == _highest_sent) {
+            _RFC2988_RTO_timeout = 0;
+        }
+
+        uint32_t new_data = seqno - _last_acked;
+        while (!_sk->scoreboard.empty() && _last_acked < seqno) {
+            Segment &seg = _sk->scoreboard.front();
+            if (seg.sacked) {
+                _sk->sacked_out--;
+            } else {
+                deliver(seg, _last_acked + 1, current_ts);
+            }
+            _sk->scoreboard.pop_front();
+            _last_acked += MSS_BYTES;
+        }
+        _last_acked = seqno;
+        _dupacks = 0;
+
+        if (_state != FAST_RECOV) {
+            inflateWindow(new_data);
+            if (_logger) _logger->logTcp(*this, TcpLogger::TCP_RCV);
+        } else if (seqno >= _recover_seq) {
+            // The whole recovery window is acked, cwnd is already ssthresh.
+            _state = CONG_AVOID;
+            if (_logger) _logger->logTcp(*this, TcpLogger::TCP_RCV_FR_END);
+        } else {
+            if (_logger) _logger->logTcp(*this, TcpLogger::TCP_RCV_FR);
+        }
+    }
+
+    // Selective acks; blocks start on segment boundaries.
+    for (uint32_t i = 0; i < nblocks; i++) {
+        uint64_t start = max(blocks[i].start, (uint64_t)_last_acked + 1);
+        for (uint64_t s = start; s < blocks[i].end; s += MSS_BYTES) {
+            uint64_t idx = (s - _last_acked - 1) / MSS_BYTES;
+            if (idx >= _sk->scoreboard.size()) {
+                break;
+            }
+
+            Segment &seg = _sk->scoreboard[idx];
+            if (!seg.sacked) {
+                deliver(seg, s, current_ts);
+                _sk->sacked_out++;
+            }
+        }
+    }
+
+    // Holes can only be lost while something above them was delivered.
+    if (_sk->sacked_out > 0 && detectLosses(current_ts) > 0) {
+        enterRecovery();
+    }
+
+    sendSackPackets();
+}
+
+void
+TcpSrc::sackTimeout()
+{
+    // Everything not selectively acked is presumed lost and is resent in
+    // slow start, without going back over SACKed segments.
+    for (auto &seg : _sk->scoreboard) {
+        if (inFlight(seg)) {
+            _sk->pipe--;
+            _sk->lost_out++;
+        }
+        if (!seg.sacked) {
+            seg.lost = true;
+            seg.retrans = false;
+        }
+    }
+
+    _sk->reo_deadline = 0;
+    sendSackPackets();
+}
+
+void
+TcpSrc::sendSackPackets()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    // Lost segments go first, then new data, as long as the pipe allows.
+    while ((_sk->pipe + 1) * MSS_BYTES <= _cwnd) {
+        if (_pacer != NULL && (_sk->lost_out > 0 || _flowsize == 0 || _highest_sent < _flowsize)
+                && paceHold()) {
+            break;
+        }
+
+        if (_sk->lost_out > 0) {
+            uint64_t idx = 0;
+            while (!_sk->scoreboard[idx].lost || _sk->scoreboard[idx].retrans || _sk->scoreboard[idx].sacked) {
+                idx++;
+            }
+
+            Segment &seg = _sk->scoreboard[idx];
+            seg.retrans = true;
+            seg.xmit_ts = current_ts;
+            _sk->lost_out--;
+            _sk->pipe++;
+            sendSegment(_last_acked + 1 + idx * MSS_BYTES, true);
+        } else if (_flowsize == 0 || _highest_sent < _flowsize) {
+            _sk->scoreboard.push_back({current_ts, false, false, false});
+            _sk->pipe++;
+            sendSegment(_highest_sent + 1, false);
+            _highest_sent += MSS_BYTES;
+        } else {
+            break;
+        }
+    }
+
+    // Probe for a tail loss after two RTTs without an ack.
+    if (_state != FAST_RECOV && _highest_sent > _last_acked && _rtt > 0) {
+        _sk->tlp_deadline = current_ts + 2 * _rtt;
+    } else {
+        _sk->tlp_deadline = 0;
+    }
+
+    armLossTimer();
+}
+
+void
+TcpSrc::sendProbe()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+
+    // New data if there is any, so that the probe can itself be SACKed.
+    if (_flowsize == 0 || _highest_sent < _flowsize) {
+        _sk->scoreboard.push_back({current_ts, false, false, false});
+        _sk->pipe++;
+        sendSegment(_highest_sent + 1, false);
+        _highest_sent += MSS_BYTES;
+        return;
+    }
+
+    // Otherwise the highest segment not yet SACKed.
+    for (uint64_t idx = _sk->scoreboard.size(); idx-- > 0; ) {
+        Segment &seg = _sk->scoreboard[idx];
+        if (seg.sacked) {
+            continue;
+        }
+
+        if (!inFlight(seg)) {
+            _sk->lost_out--;
+            _sk->pipe++;
+        }
+        seg.retrans = seg.lost;
+        seg.xmit_ts = current_ts;
+        sendSegment(_last_acked + 1 + idx * MSS_BYTES, true);
+        return;
+    }
+}
+
+void
+TcpSrc::deliver(Segment &seg,
+                uint64_t seqno,
+                simtime_picosec now)
+{
+    if (inFlight(seg)) {
+        _sk->pipe--;
+    } else {
+        _sk->lost_out--;
+    }
+    seg.sacked = true;
+
+    // A retransmission acked within min_rtt was likely the original's ack.
+    if (seg.retrans && now - seg.xmit_ts < _min_rtt) {
+        return;
+    }
+
+    if (seg.xmit_ts > _sk->rack_xmit_ts || (seg.xmit_ts == _sk->rack_xmit_ts && seqno > _sk->rack_seq)) {
+        _sk->rack_xmit_ts = seg.xmit_ts;
+        _sk->rack_seq = seqno;
+        _sk->rack_rtt = now - seg.xmit_ts;
+    }
+}
+
+uint32_t
+TcpSrc::detectLosses(simtime_picosec now)
+{
+    simtime_picosec reo_wnd = _min_rtt / 4;
+    uint32_t lost = 0;
+    _sk->reo_deadline = 0;
+
+    // A segment is lost once one sent after it was delivered and the
+    // reordering window has passed since it was sent.
+    for (uint64_t idx = 0; idx < _sk->scoreboard.size(); idx++) {
+        Segment &seg = _sk->scoreboard[idx];
+        uint64_t seqno = _last_acked + 1 + idx * MSS_BYTES;
+        if (!inFlight(seg) || seg.xmit_ts > _sk->rack_xmit_ts ||
+                (seg.xmit_ts == _sk->rack_xmit_ts && seqno >= _sk->rack_seq)) {
+            continue;
+        }
+
+        simtime_picosec deadline = seg.xmit_ts + _sk->rack_rtt + reo_wnd;
+        if (now >= deadline) {
+            seg.lost = true;
+            seg.retrans = false;
+            _sk->pipe--;
+            _sk->lost_out++;
+            lost++;
+        } else if (_sk->reo_deadline == 0 || deadline < _sk->reo_deadline) {
+            _sk->reo_deadline = deadline;
+        }
+    }
+
+    return lost;
+}
+
+void
+TcpSrc::enterRecovery()
+{
+    // See RFC 3782: not again until the previous recovery or timeout is over.
+    if (_state == FAST_RECOV || _last_acked < _recover_seq) {
+        return;
+    }
+
+    _drops++;
+    reduceWindow();
+    _cwnd = _ssthresh;
+    _state = FAST_RECOV;
+    _recover_seq = _highest_sent;
+
+    if (_logger) _logger->logTcp(*this, TcpLogger::TCP_RCV_DUP_FASTXMIT);
+}
+
+void
+TcpSrc::armLossTimer()
+{
+    simtime_picosec next = _sk->reo_deadline;
+    if (_sk->tlp_deadline != 0 && (next == 0 || _sk->tlp_deadline < next)) {
+        next = _sk->tlp_deadline;
+    }
+
+    // An event at or before next will re-arm the timer when it fires.
+    if (next == 0 || (_sk->timer_at != 0 && _sk->timer_at <= next)) {
+        return;
+    }
+
+    _sk->timer_at = next;
+    _sk->timer_events++;
+    EventList::Get().sourceIsPending(*_sk, next);
+}
+
+void
+TcpSrc::lossTimeout()
+{
+    simtime_picosec now = EventList::Get().now();
+    _sk->timer_events--;
+
+    if (_state == FINISH) {
+        _flow.wake();
+        return;
+    }
+
+    // Superseded by an earlier deadline.
+    if (now != _sk->timer_at) {
+        return;
+    }
+    _sk->timer_at = 0;
+
+    if (_sk->reo_deadline != 0 && now >= _sk->reo_deadline) {
+        if (detectLosses(now) > 0) {
+            enterRecovery();
+        }
+        sendSackPackets();
+    }
+
+    if (_sk->tlp_deadline != 0 && now >= _sk->tlp_deadline) {
+        _sk->tlp_deadline = 0;
+        refreshRoutes();
+        sendProbe();
+    }
+
+    armLossTimer();
+}
+
+void
+TcpSrc::armReorderTimer()
+{
+    // An event at or before the deadline will re-arm the timer when it fires.
+    if (_ro->deadline == 0 || (_ro->timer_at != 0 && _ro->timer_at <= _ro->deadline)) {
+        return;
+    }
+
+    _ro->timer_at = _ro->deadline;
+    _ro->timer_events++;
+    EventList::Get().sourceIsPending(*_ro, _ro->deadline);
+}
+
+void
+TcpSrc::reorderTimeout()
+{
+    simtime_picosec now = EventList::Get().now();
+    _ro->timer_events--;
+
+    if (_state == FINISH) {
+        _flow.wake();
+        return;
+    }
+
+    // Superseded by an earlier deadline.
+    if (now != _ro->timer_at) {
+        return;
+    }
+    _ro->timer_at = 0;
+
+    // The hole outlived the reordering window with no dupack since to
+    // notice: retransmit it now rather than wait for the RTO.
+    if (_ro->deadline != 0 && now >= _ro->deadline) {
+        _ro->deadline = 0;
+        if (_state != FAST_RECOV && _dupacks >= 3 && _last_acked >= _recover_seq) {
+            fastRetransmit();
+        }
+    }
+
+    armReorderTimer();
+}
+
+
+TcpSink::TcpSink()
+    : DataSink(),
+    _delack_segs(1),
+    _delack_timeout(0),
+    _timer(NULL),
+    _pending_segs(0),
+    _pending_ts(0),
+    _ack_deadline(0),
+    _ce_state(false),
+    _timer_scheduled(false),
+    _last_seqno(0)
+{}
+
+TcpSink::~TcpSink()
+{
+    delete _timer;
+}
+
+void
+TcpSink::setDelayedAck(uint32_t segs,
+                       simtime_picosec timeout)
+{
+    _delack_segs = max(segs, 1u);
+    _delack_timeout = timeout;
+
+    if (_delack_segs > 1 && _timer == NULL) {
+        _timer = new AckTimer(*this);
+    }
+}
 
 void
 TcpSink::receivePacket(Packet &pkt)
 {
     DataPacket *p = (DataPacket*)(&pkt);
     simtime_picosec ts = p->ts();
+    bool ce = p->getFlag(Packet::ECN_FWD);
+    DataAck::seq_t prev_ack = cumulative_ack();
+    _last_seqno = p->seqno();
     processDataPacket(*p);
 
     if (p->getFlag(Packet::DEADLINE)) {
@@ -474,15 +1112,89 @@ TcpSink::receivePacket(Packet &pkt)
         totalPkts += 1;
     }
 
+    bool in_order = (cumulative_ack() == prev_ack + p->size()) && _received.empty();
+
+    TcpSrc *src = (TcpSrc*)_src;
+    if (src->_msgs != NULL && !src->_msgs->onAck && cumulative_ack() > prev_ack) {
+        src->messagesDone(cumulative_ack());
+    }
+
     pkt.flow().logTraffic(pkt, *this, TrafficLogger::PKT_RCVDESTROY);
     p->free();
 
-    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, 1, _cumulative_ack);
+    if (_delack_segs == 1) {
+        sendAck(ts, ce);
+        return;
+    }
+
+    // ACK what is pending before the CE state changes, so the sender sees
+    // exactly which segments were marked (DCTCP).
+    if (ce != _ce_state) {
+        if (_pending_segs > 0) {
+            sendAck(_pending_ts, _ce_state);
+        }
+        _ce_state = ce;
+    }
+
+    bool done = (_src->_flowsize > 0 && cumulative_ack() >= _src->_flowsize);
+
+    // Holes and hole fills are ACKed at once to keep loss recovery fast.
+    if (!in_order || done) {
+        sendAck(_pending_segs > 0 ? _pending_ts : ts, ce);
+        return;
+    }
+
+    if (_pending_segs == 0) {
+        _pending_ts = ts;
+        _ack_deadline = EventList::Get().now() + _delack_timeout;
+        if (!_timer_scheduled) {
+            _timer_scheduled = true;
+            EventList::Get().sourceIsPending(*_timer, _ack_deadline);
+        }
+    }
+    _pending_segs++;
+
+    if (_pending_segs >= _delack_segs) {
+        sendAck(_pending_ts, _ce_state);
+    }
+}
+
+void
+TcpSink::sendAck(simtime_picosec ts,
+                 bool ecn)
+{
+    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, 1, cumulative_ack());
     ack->flow().logTraffic(*ack, *this, TrafficLogger::PKT_CREATESEND);
     ack->set_ts(ts);
-    if (p->getFlag(Packet::ECN_FWD)) {
+    if (ecn) {
         ack->setFlag(Packet::ECN_REV);
     }
+    if (((TcpSrc*)_src)->_sack && !_received.empty()) {
+        ack->setNSack(_received.sackBlocks(ack->sackBlocks(), MAX_SACK_BLOCKS, _last_seqno));
+    }
     ack->sendOn();
+
+    _pending_segs = 0;
+}
+
+void
+TcpSink::ackTimeout()
+{
+    simtime_picosec now = EventList::Get().now();
+
+    // The timer can't be cancelled, so it may belong to segments that have
+    // since been ACKed. Re-arm it for the current ones, if any.
+    if (_pending_segs > 0 && now < _ack_deadline) {
+        EventList::Get().sourceIsPending(*_timer, _ack_deadline);
+        return;
+    }
+
+    _timer_scheduled = false;
+    if (_pending_segs > 0) {
+        sendAck(_pending_ts, _ce_state);
+    }
+
+    // The source may be waiting on this timer to free the flow.
+    _src->_flow.wake();
 }
 
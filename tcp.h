@@ -6,22 +6,63 @@
 
 #include "eventlist.h"
 #include "datasource.h"
+#include "pacer.h"
+
+#include <deque>
+#include <functional>
 
 #define DCTCP_GAIN 0.0625
 
+// CUBIC (RFC 8312) constants.
+#define CUBIC_C    0.4
+#define CUBIC_BETA 0.7
+
 class TcpSink;
 class FlowGenerator;
 
-class TcpSrc : public DataSource
+class TcpSrc : public DataSource, public PacedSource, public Pooled<TcpSrc>
 {
     friend class TcpSink;
     public:
     TcpSrc(TcpLogger *logger, TrafficLogger *pktlogger,
             uint32_t flowsize = 0, simtime_picosec duration = 0);
+    ~TcpSrc();
 
     void printStatus();
     void doNextEvent();
     void receivePacket(Packet &pkt);
+    void pacedSend();
+
+    // Spreads each window over an RTT in bursts of quantum segments, at
+    // 2x cwnd/RTT in slow start and 1.2x in congestion avoidance (as Linux
+    // does), with the host's shared pacer timing the bursts.
+    void setPacing(uint32_t quantum, HostPacer &pacer);
+
+    // Persistent connections carry a run of messages instead of one flow,
+    // keeping cwnd, RTT estimates and DCTCP alpha from one to the next.
+    // Each message starts on a fresh segment, and handler(tag) runs once the
+    // sink has all of it, or with onAck once the source has the ack for all
+    // of it (when a one-off flow would finish). The connection never
+    // finishes, and has no events pending while all it was given is
+    // acknowledged.
+    typedef std::function<void(uint64_t tag)> MessageHandler;
+    void setPersistent(MessageHandler handler, bool onAck = false);
+
+    // Queues a message on a persistent connection, once it is connected.
+    void sendMessage(uint64_t bytes, uint64_t tag);
+
+    // Whether a persistent connection has all it was given acknowledged.
+    inline bool idle() const {
+        return _highest_sent >= _flowsize && _last_acked >= _highest_sent;
+    }
+
+    // Congestion control, chosen per flow. Dispatched with a switch, so the
+    // ACK path makes no virtual calls.
+    enum CongestionControl {
+        CC_NEWRENO,
+        CC_DCTCP,
+        CC_CUBIC
+    } _cc;
 
     // Flow status.
     enum FlowStatus {
@@ -42,40 +83,211 @@ class TcpSrc : public DataSource
 
     // RTT, RTO estimates.
     simtime_picosec _rtt, _rto, _mdev;
+    simtime_picosec _min_rtt;
     simtime_picosec _RFC2988_RTO_timeout;
 
+    // Reordering-resilient loss detection (RACK-style time threshold).
+    // Dupacks only trigger fast retransmit once the hole has been out for
+    // the min RTT plus a quarter of it since it was sent, so sprayed
+    // packets aren't mistaken for losses. A timer fires at that deadline
+    // in case no more dupacks come.
+    bool _reorder_tolerant;
+
+    // SACK loss recovery (RFC 6675) with RACK-TLP loss detection (RFC 8985)
+    // instead of dupack counting. Lost segments are retransmitted as soon as
+    // they are detected, so recovering from several losses takes about one
+    // RTT, and a tail loss probe replaces most timeouts at the end of flows.
+    bool _sack;
+
     // DCTCP variables;
     double _alpha;
     uint32_t _marked_pkts;
     uint32_t _total_pkts;
     uint64_t _dctcp_cwnd;
 
-    // DCTCP enable flag.
-    static bool _enable_dctcp;
+    // CUBIC variables.
+    uint32_t _cubic_wmax;             // Window before the last reduction.
+    simtime_picosec _cubic_epoch;     // Start of the current growth epoch.
+    double _cubic_k;                  // Seconds to grow back to the origin.
+    double _cubic_origin;             // Window the cubic is centred on.
+    double _cubic_west;               // Reno-friendly window estimate.
 
     static std::map<uint64_t, uint64_t> slacks;
     static uint64_t totalPkts;
 
     private:
+    // Sender state of a segment between _last_acked and _highest_sent.
+    struct Segment {
+        simtime_picosec xmit_ts; // Last (re)transmission.
+        bool sacked;
+        bool lost;
+        bool retrans;            // Retransmitted since it was marked lost.
+    };
+
+    // SACK scoreboard and RACK-TLP state, kept out of line as only SACK
+    // flows use it. Also the event source of the loss timer.
+    class SackState : public EventSource, public Pooled<SackState>
+    {
+        public:
+        SackState(TcpSrc &src)
+            : EventSource("LossTimer"), pipe(0), lost_out(0), sacked_out(0),
+              rack_xmit_ts(0), rack_seq(0), rack_rtt(0), reo_deadline(0),
+              tlp_deadline(0), timer_at(0), timer_events(0), _src(src) {}
+        void doNextEvent() {_src.lossTimeout();}
+
+        std::deque<Segment> scoreboard; // From _last_acked + 1 on.
+        uint32_t pipe;                  // Segments in flight.
+        uint32_t lost_out;              // Lost segments not yet retransmitted.
+        uint32_t sacked_out;            // SACKed segments above _last_acked.
+
+        // RACK: send time and RTT of the most recently sent segment delivered.
+        simtime_picosec rack_xmit_ts;
+        uint64_t rack_seq;
+        simtime_picosec rack_rtt;
+
+        // Reordering window and tail loss probe deadlines, 0 when unset. The
+        // timer can't be cancelled, so only the event due at timer_at is
+        // acted on; earlier-scheduled ones are left to expire.
+        simtime_picosec reo_deadline;
+        simtime_picosec tlp_deadline;
+        simtime_picosec timer_at;
+        uint32_t timer_events;
+
+        private:
+        TcpSrc &_src;
+    };
+
     // Mechanism
-    void inflateWindow();
+    void inflateWindow(uint32_t acked);
+    uint32_t cubicIncrement(uint32_t acked);
+    void reduceWindow();
     void sendPackets();
     void retransmitPacket(int reason);
+    void sendSegment(uint64_t seqno, bool retransmit);
+    bool paceHold();
+
+    // Whether a finished flow has no packets or timers left.
+    bool drained();
+
+    // Runs the handlers of the messages that end by ackno.
+    void messagesDone(uint64_t ackno);
+
+    // SACK recovery.
+    void sackReceive(uint64_t seqno, const SackBlock *blocks, uint32_t nblocks);
+    void sackTimeout();
+    void sendSackPackets();
+    void sendProbe();
+    void deliver(Segment &seg, uint64_t seqno, simtime_picosec now);
+    uint32_t detectLosses(simtime_picosec now);
+    void enterRecovery();
+    void armLossTimer();
+    void lossTimeout();
+
+    // Fast retransmit without SACK, and the reordering window timer.
+    void fastRetransmit();
+    void armReorderTimer();
+    void reorderTimeout();
+
+    inline bool inFlight(const Segment &seg) const {
+        return !seg.sacked && (!seg.lost || seg.retrans);
+    }
+
+    SackState *_sk;                  // Created when a SACK flow starts.
+
+    // Reordering window of reorder-tolerant flows without SACK: send times
+    // of the segments in flight, and the deadline of the hole at
+    // _last_acked + 1. Also the event source of its timer, which like the
+    // loss timer is never cancelled; only the event due at timer_at acts.
+    class ReorderState : public EventSource, public Pooled<ReorderState>
+    {
+        public:
+        ReorderState(TcpSrc &src)
+            : EventSource("ReorderTimer"), deadline(0), timer_at(0), timer_events(0),
+              _src(src) {}
+        void doNextEvent() {_src.reorderTimeout();}
+
+        std::deque<simtime_picosec> xmit_ts; // From _last_acked + 1 on.
+        simtime_picosec deadline;
+        simtime_picosec timer_at;
+        uint32_t timer_events;
+
+        private:
+        TcpSrc &_src;
+    };
+
+    ReorderState *_ro;               // Created when such a flow starts.
+
+    // Messages of a persistent connection not yet done, each with the
+    // sequence number it ends at. Out of line, as most flows are one-off.
+    struct Message {
+        uint64_t end;
+        uint64_t tag;
+    };
+
+    struct Messages {
+        std::deque<Message> queue;
+        MessageHandler handler;
+        bool onAck;                  // Done at the source, not the sink.
+    };
+
+    Messages *_msgs;
+
+    // Pacing, off while _pacer is NULL.
+    HostPacer *_pacer;
+    uint32_t _pace_quantum;
+    uint32_t _pace_burst;            // Segments left in the current burst.
+    simtime_picosec _pace_next;      // Earliest start of the next burst.
+    bool _pace_pending;              // Waiting on the pacer.
 
     // Housekeeping
     TcpLogger *_logger;
 };
 
-class TcpSink : public DataSink
+class TcpSink : public DataSink, public Pooled<TcpSink>
 {
     friend class TcpSrc;
     public:
     TcpSink();
+    ~TcpSink();
     void receivePacket(Packet &pkt);
     void printStatus();
 
+    // Delayed ACKs: ACK every segs in-order segments, or timeout after the
+    // first unacknowledged one. Out-of-order segments, ECN-CE transitions
+    // (as DCTCP requires) and the end of the flow are ACKed immediately.
+    void setDelayedAck(uint32_t segs, simtime_picosec timeout);
+
+    // Whether the delayed-ACK timer still has an event scheduled.
+    inline bool timerPending() const {return _timer_scheduled;}
+
     static std::map<uint64_t, uint64_t> slacks;
     static uint64_t totalPkts;
+
+    private:
+    class AckTimer : public EventSource
+    {
+        public:
+        AckTimer(TcpSink &sink) : EventSource("AckTimer"), _sink(sink) {}
+        void doNextEvent() {_sink.ackTimeout();}
+
+        private:
+        TcpSink &_sink;
+    };
+
+    void sendAck(simtime_picosec ts, bool ecn);
+    void ackTimeout();
+
+    uint32_t _delack_segs;            // Segments per ACK, 1 disables delayed ACKs.
+    simtime_picosec _delack_timeout;
+    AckTimer *_timer;
+
+    uint32_t _pending_segs;           // In-order segments not yet ACKed.
+    simtime_picosec _pending_ts;      // Timestamp to echo, of the first of them.
+    simtime_picosec _ack_deadline;
+    bool _ce_state;                   // ECN-CE of the last segment received.
+    bool _timer_scheduled;
+
+    DataAck::seq_t _last_seqno;       // Reported first in SACK blocks.
 };
 
 #endif /* TCP_H_ */
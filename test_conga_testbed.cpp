@@ -7,88 +7,48 @@
 #include "logfile.h"
 #include "loggers.h"
 #include "queue.h"
-#include "fairqueue.h"
-#include "priorityqueue.h"
-#include "aprx-fairqueue.h"
-#include "stoc-fairqueue.h"
 #include "pipe.h"
 #include "leafswitch.h"
+#include "topology.h"
 #include "flow-generator.h"
 #include "test.h"
 
 using namespace std;
 
 namespace conga_conf {
-    static const int N_CORE   = 12;
-    static const int N_LEAF   = 24;
-    static const int N_SERVER = 32;   // per leaf
-
-    static const uint64_t LEAF_BUFFER = 512000;
-    static const uint64_t CORE_BUFFER = 1024000;
-    static const uint64_t ENDH_BUFFER = 8192000;
-
-    static const uint64_t LEAF_SPEED  = 10000000000ULL; // 10G
-    static const uint64_t CORE_SPEED  = 40000000000ULL; // 40G
-    static const uint64_t LINK_DELAY_US = 1;
-
-    struct Topo {
-        vector<LeafSwitch*> leafSwitches;
-
-        // [leaf][core]
-        vector<vector<Queue*>> leafToCoreQ;
-        vector<vector<Pipe*>>  leafToCoreP;
-
-        // [core][leaf]
-        vector<vector<Queue*>> coreToLeafQ;
-        vector<vector<Pipe*>>  coreToLeafP;
-
-        // [leaf][serverLocal]
-        vector<vector<Queue*>> leafToServerQ;
-        vector<vector<Pipe*>>  leafToServerP;
-        vector<vector<Queue*>> serverToLeafQ;
-        vector<vector<Pipe*>>  serverToLeafP;
-
-        vector<uint32_t> serverToLeafMap;
+    // Default fabric: 12 spines (40G), 24 leaves with 32 servers (10G) each.
+    // Any of these can be overridden with --<key>=<value> or --topofile.
+    const ArgList DEFAULTS = {
+        {"topo",         "leafspine"},
+        {"nserver",      "32"},       // per leaf
+        {"nleaf",        "24"},
+        {"nspine",       "12"},
+        {"hostspeed",    "10"},       // Gbps
+        {"edgespeed",    "40"},       // Gbps
+        {"buf_hostup",   "8192000"},  // endhost buffer
+        {"buf_hostdown", "512000"},   // leaf buffer
+        {"buf_edgeup",   "512000"},   // leaf buffer
+        {"buf_edgedown", "1024000"},  // core buffer
+        {"linkdelay",    "1"}         // us
     };
 
-    static Topo topo;
-}
-
-static inline uint32_t getLeafForServer(uint32_t sid) {
-    return sid / conga_conf::N_SERVER;
-}
-static inline uint32_t getLocalServerIndex(uint32_t sid) {
-    return sid % conga_conf::N_SERVER;
-}
+    static const uint64_t ENDH_BUFFER = 8192000;
 
-static Queue* makeQueue(const string& qtype,
-                        uint64_t speed,
-                        uint64_t buffer,
-                        QueueLogger* qlog,
-                        const string& name,
-                        Logfile& logfile)
-{
-    Queue* q = nullptr;
-    if (qtype == "fq")      q = new FairQueue(speed, buffer, qlog);
-    else if (qtype == "pq") q = new PriorityQueue(speed, buffer, qlog);
-    else if (qtype == "sfq")q = new StocFairQueue(speed, buffer, qlog);
-    else if (qtype == "afq")q = new AprxFairQueue(speed, buffer, qlog);
-    else                    q = new Queue(speed, buffer, qlog); // droptail
-    q->setName(name);
-    logfile.writeName(*q);
-    return q;
+    static LeafSpineTopology *topo;
+    static DownlinkTable *downlinks;
+    static vector<LeafSwitch*> leafSwitches;
 }
 
 // global policy flag set from args: "ecmp" (default) or "conga"
 static string g_policy = "conga";
 
 // Route gen uses policy:
-static void route_gen(route_t *&fwd, route_t *&rev, uint32_t &src, uint32_t &dst)
+static void route_gen(const route_t *&fwd, const route_t *&rev, uint32_t &src, uint32_t &dst)
 {
     using namespace conga_conf;
     static std::mt19937 rng(0xC0A6A5u);
 
-    const uint32_t TOTAL_SERVERS = N_LEAF * N_SERVER;
+    const uint32_t TOTAL_SERVERS = topo->nHosts();
     auto pick_pair = [&]() {
         std::uniform_int_distribution<uint32_t> U(0, TOTAL_SERVERS - 1);
         src = U(rng);
@@ -96,62 +56,22 @@ static void route_gen(route_t *&fwd, route_t *&rev, uint32_t &src, uint32_t &dst
     };
     if (src >= TOTAL_SERVERS || dst >= TOTAL_SERVERS || src == dst) pick_pair();
 
-    uint32_t srcLeaf = getLeafForServer(src);
-    uint32_t dstLeaf = getLeafForServer(dst);
-    uint32_t localSrc = getLocalServerIndex(src);
-    uint32_t localDst = getLocalServerIndex(dst);
+    uint32_t srcLeaf = topo->rack(src);
+    uint32_t dstLeaf = topo->rack(dst);
 
-    fwd = new route_t();
-    rev = new route_t();
-
-    if (srcLeaf == dstLeaf) {
-        // Same rack
-        fwd->push_back(conga_conf::topo.serverToLeafQ[srcLeaf][localSrc]);
-        fwd->push_back(conga_conf::topo.serverToLeafP[srcLeaf][localSrc]);
-        fwd->push_back(conga_conf::topo.leafToServerQ[dstLeaf][localDst]);
-        fwd->push_back(conga_conf::topo.leafToServerP[dstLeaf][localDst]);
-
-        rev->push_back(conga_conf::topo.serverToLeafQ[dstLeaf][localDst]);
-        rev->push_back(conga_conf::topo.serverToLeafP[dstLeaf][localDst]);
-        rev->push_back(conga_conf::topo.leafToServerQ[srcLeaf][localSrc]);
-        rev->push_back(conga_conf::topo.leafToServerP[srcLeaf][localSrc]);
-        return;
-    }
-
-    // Choose core by policy
+    // Choose core by policy (unused within a rack)
     uint32_t chosenCore = 0;
-    if (g_policy == "conga") {
-        chosenCore = conga_conf::topo.leafSwitches[srcLeaf]->chooseCore(dstLeaf);
-    } else {
-        // ECMP hash
-        chosenCore = (src * 1315423911u + dst) % N_CORE;
+    if (srcLeaf != dstLeaf) {
+        if (g_policy == "conga") {
+            chosenCore = leafSwitches[srcLeaf]->chooseCore(dstLeaf);
+        } else {
+            // ECMP hash
+            chosenCore = (src * 1315423911u + dst) % topo->nSpine();
+        }
     }
 
-    // FWD
-    fwd->push_back(conga_conf::topo.serverToLeafQ[srcLeaf][localSrc]);
-    fwd->push_back(conga_conf::topo.serverToLeafP[srcLeaf][localSrc]);
-
-    fwd->push_back(conga_conf::topo.leafToCoreQ[srcLeaf][chosenCore]);
-    fwd->push_back(conga_conf::topo.leafToCoreP[srcLeaf][chosenCore]);
-
-    fwd->push_back(conga_conf::topo.coreToLeafQ[chosenCore][dstLeaf]);
-    fwd->push_back(conga_conf::topo.coreToLeafP[chosenCore][dstLeaf]);
-
-    fwd->push_back(conga_conf::topo.leafToServerQ[dstLeaf][localDst]);
-    fwd->push_back(conga_conf::topo.leafToServerP[dstLeaf][localDst]);
-
-    // REV
-    rev->push_back(conga_conf::topo.serverToLeafQ[dstLeaf][localDst]);
-    rev->push_back(conga_conf::topo.serverToLeafP[dstLeaf][localDst]);
-
-    rev->push_back(conga_conf::topo.leafToCoreQ[dstLeaf][chosenCore]);
-    rev->push_back(conga_conf::topo.leafToCoreP[dstLeaf][chosenCore]);
-
-    rev->push_back(conga_conf::topo.coreToLeafQ[chosenCore][srcLeaf]);
-    rev->push_back(conga_conf::topo.coreToLeafP[chosenCore][srcLeaf]);
-
-    rev->push_back(conga_conf::topo.leafToServerQ[srcLeaf][localSrc]);
-    rev->push_back(conga_conf::topo.leafToServerP[srcLeaf][localSrc]);
+    fwd = topo->route(src, dst, chosenCore);
+    rev = topo->route(dst, src, chosenCore);
 }
 
 void conga_testbed(const ArgList &args, Logfile &logfile)
@@ -164,6 +84,27 @@ void conga_testbed(const ArgList &args, Logfile &logfile)
     string   FlowDist    = "uniform";
     string   QueueType   = "droptail";
     string   EndHost     = "tcp";
+    uint32_t Rack        = 0;     // RACK-style reordering window in TCP
+    string   LinkEvents  = "";    // Link failures/rate changes (see LinkSchedule)
+    uint32_t DelAck      = 1;     // Segments per ACK (1 = no delayed ACKs)
+    double   DelAckUs    = 10;    // Delayed ACK timeout (us)
+    uint32_t Sack        = 0;     // SACK + RACK-TLP loss recovery in TCP
+    uint32_t Pacing      = 0;     // TCP pacing burst in segments (0 = off)
+    string   Nic         = "";    // Shared host NIC: fifo/rr/srpt ("" = queue per flow)
+    string   Trace       = "";    // Flow arrivals to replay (see FlowTrace)
+    string   Traffic     = "";    // Patterns and load shares, e.g. incast:0.2 (see TrafficMatrix)
+    string   Schedule    = "";    // Load over time, e.g. 0:0.1,2:0.5 (see LoadSchedule)
+    uint32_t LoadRamp    = 0;     // Ramp between schedule points instead of steps
+    uint32_t HostArr     = 0;     // Arrival process per host instead of one global one
+    double   LocalRatio  = -1;    // Share of rack-local flows with HostArr (< 0 = uniform)
+    string   RackLoad    = "";    // Rate scale of some racks with HostArr, e.g. 0:2,3:0.5
+    uint32_t Partitions  = 1;     // Independent arrival partitions with HostArr
+    uint32_t Batch       = 0;     // Arrivals drawn ahead per block (0 = one at a time)
+    uint32_t Rpc         = 0;     // Closed-loop RPCs open per client instead of flows
+    uint32_t RpcRequest  = 256;   // RPC request size in bytes
+    uint32_t ConnPool    = 0;     // Flows of a host pair share a persistent connection
+    double   Converge    = 0;     // Stop once FCT/utilization CIs are this tight (0 = off)
+    double   ConvergeMs  = 10;    // Convergence monitor window in ms
     parseInt(args, "duration", Duration);
     parseDouble(args, "utilization", Util);
     parseInt(args, "flowsize", AvgFlowSize);
@@ -171,119 +112,168 @@ void conga_testbed(const ArgList &args, Logfile &logfile)
     parseString(args, "queue", QueueType);
     parseString(args, "endhost", EndHost);
     parseString(args, "policy",  g_policy); // "conga" (default) or "ecmp"
+    parseInt(args, "rack", Rack);
+    parseString(args, "linkevents", LinkEvents);
+    parseInt(args, "delack", DelAck);
+    parseDouble(args, "delacktimeout", DelAckUs);
+    parseInt(args, "sack", Sack);
+    parseInt(args, "pacing", Pacing);
+    parseString(args, "nic", Nic);
+    parseString(args, "trace", Trace);
+    parseString(args, "traffic", Traffic);
+    parseString(args, "loadschedule", Schedule);
+    parseInt(args, "loadramp", LoadRamp);
+    parseInt(args, "hostarrivals", HostArr);
+    parseDouble(args, "localratio", LocalRatio);
+    parseString(args, "rackload", RackLoad);
+    parseInt(args, "partitions", Partitions);
+    parseInt(args, "batch", Batch);
+    parseInt(args, "rpc", Rpc);
+    parseInt(args, "rpcrequest", RpcRequest);
+    parseInt(args, "connpool", ConnPool);
+    parseDouble(args, "converge", Converge);
+    parseDouble(args, "convergewindow", ConvergeMs);
 
     // TCP logger for FCTs
     auto *logTcp = new TcpLoggerSimple();
     logfile.addLogger(*logTcp);
 
-    // Allocate topology matrices
-    topo.leafToCoreQ.assign(N_LEAF, vector<Queue*>(N_CORE, nullptr));
-    topo.leafToCoreP.assign(N_LEAF, vector<Pipe*>(N_CORE, nullptr));
-    topo.coreToLeafQ.assign(N_CORE, vector<Queue*>(N_LEAF, nullptr));
-    topo.coreToLeafP.assign(N_CORE, vector<Pipe*>(N_LEAF, nullptr));
-    topo.leafToServerQ.assign(N_LEAF, vector<Queue*>(N_SERVER, nullptr));
-    topo.leafToServerP.assign(N_LEAF, vector<Pipe*>(N_SERVER, nullptr));
-    topo.serverToLeafQ.assign(N_LEAF, vector<Queue*>(N_SERVER, nullptr));
-    topo.serverToLeafP.assign(N_LEAF, vector<Pipe*>(N_SERVER, nullptr));
-    topo.serverToLeafMap.resize(N_LEAF * N_SERVER);
-
-    // Create leaf switches
-    topo.leafSwitches.reserve(N_LEAF);
-    for (int leaf = 0; leaf < N_LEAF; ++leaf) {
-        auto *lsw = new LeafSwitch(leaf, N_CORE, N_LEAF, EventList::Get());
-        lsw->setAlpha(0.6);                               
-        lsw->setSamplingPeriod(timeFromUs(5));           
-        lsw->setWeights(0.5, 0.5);                       
-        lsw->setEps(1e-3);                               
-        topo.leafSwitches.push_back(lsw);
+    // Build the fabric
+    topo = dynamic_cast<LeafSpineTopology*>(Topology::create(DEFAULTS, args));
+    if (topo == NULL) {
+        cerr << "conga_testbed needs a leaf-spine topology" << endl;
+        exit(1);
     }
+    topo->build();
+    topo->writeNames(logfile);
+    topo->printSummary();
 
-    // Leaf <-> Core wiring
-    for (int leaf = 0; leaf < N_LEAF; ++leaf) {
-        for (int core = 0; core < N_CORE; ++core) {
-            // uplink leaf->core
-            {
-                string qn = "L" + to_string(leaf) + "_C" + to_string(core) + "_up";
-                topo.leafToCoreQ[leaf][core] = makeQueue(QueueType, CORE_SPEED, LEAF_BUFFER, nullptr, qn, logfile);
-                string pn = "pipe_L" + to_string(leaf) + "_C" + to_string(core) + "_up";
-                topo.leafToCoreP[leaf][core] = new Pipe(timeFromUs(LINK_DELAY_US));
-                topo.leafToCoreP[leaf][core]->setName(pn); logfile.writeName(*topo.leafToCoreP[leaf][core]);
+    const uint32_t N_CORE = topo->nSpine();
+    const uint32_t N_LEAF = topo->nLeaf();
 
-                topo.leafSwitches[leaf]->addUplink(core, topo.leafToCoreQ[leaf][core], topo.leafToCoreP[leaf][core]);
-            }
-            // downlink core->leaf
-            {
-                string qn = "C" + to_string(core) + "_L" + to_string(leaf) + "_down";
-                topo.coreToLeafQ[core][leaf] = makeQueue(QueueType, CORE_SPEED, CORE_BUFFER, nullptr, qn, logfile);
-                string pn = "pipe_C" + to_string(core) + "_L" + to_string(leaf) + "_down";
-                topo.coreToLeafP[core][leaf] = new Pipe(timeFromUs(LINK_DELAY_US));
-                topo.coreToLeafP[core][leaf]->setName(pn); logfile.writeName(*topo.coreToLeafP[core][leaf]);
+    // CONGA state is only needed when the policy consults it.
+    if (g_policy == "conga") {
+        // Remote core->leaf congestion, shared by all leaves (to compute dst path metric)
+        downlinks = new DownlinkTable(N_CORE, N_LEAF);
+        downlinks->setAlpha(0.6);
+        downlinks->setSamplingPeriod(timeFromUs(5));
+        for (uint32_t core = 0; core < N_CORE; ++core) {
+            for (uint32_t leaf = 0; leaf < N_LEAF; ++leaf) {
+                uint32_t link = topo->spineDown(core, leaf);
+                downlinks->registerCoreToLeaf(core, leaf, topo->queue(link), topo->pipe(link));
             }
         }
-    }
 
-    // Register remote core->leaf queues with each leaf (to compute dst path metric)
-    for (int leaf = 0; leaf < N_LEAF; ++leaf) {
-        for (int dstLeaf = 0; dstLeaf < N_LEAF; ++dstLeaf) {
-            for (int core = 0; core < N_CORE; ++core) {
-                topo.leafSwitches[leaf]->registerCoreToLeaf(core, dstLeaf,
-                    topo.coreToLeafQ[core][dstLeaf],
-                    topo.coreToLeafP[core][dstLeaf]);
+        // Create leaf switches
+        leafSwitches.reserve(N_LEAF);
+        for (uint32_t leaf = 0; leaf < N_LEAF; ++leaf) {
+            auto *lsw = new LeafSwitch(leaf, N_CORE, N_LEAF, EventList::Get());
+            lsw->setAlpha(0.6);                               
+            lsw->setSamplingPeriod(timeFromUs(5));           
+            lsw->setWeights(0.5, 0.5);                       
+            lsw->setEps(1e-3);                               
+            lsw->setDownlinkTable(downlinks);
+            leafSwitches.push_back(lsw);
+
+            // uplinks leaf->core
+            for (uint32_t core = 0; core < N_CORE; ++core) {
+                uint32_t link = topo->leafUp(leaf, core);
+                lsw->addUplink(core, topo->queue(link), topo->pipe(link));
             }
+
+            // leaf->server downlinks are not consulted for path choice, and
+            // are left to be created on first use.
         }
     }
 
-    // Leaf <-> Servers
-    for (int leaf = 0; leaf < N_LEAF; ++leaf) {
-        for (int s = 0; s < N_SERVER; ++s) {
-            uint32_t gsid = leaf * N_SERVER + s;
-            topo.serverToLeafMap[gsid] = leaf;
-
-            // server->leaf
-            {
-                string qn = "S" + to_string(gsid) + "_L" + to_string(leaf) + "_up";
-                topo.serverToLeafQ[leaf][s] = makeQueue(QueueType, LEAF_SPEED, ENDH_BUFFER, nullptr, qn, logfile);
-                string pn = "pipe_S" + to_string(gsid) + "_L" + to_string(leaf) + "_up";
-                topo.serverToLeafP[leaf][s] = new Pipe(timeFromUs(LINK_DELAY_US));
-                topo.serverToLeafP[leaf][s]->setName(pn); logfile.writeName(*topo.serverToLeafP[leaf][s]);
-            }
-            // leaf->server
-            {
-                string qn = "L" + to_string(leaf) + "_S" + to_string(gsid) + "_down";
-                topo.leafToServerQ[leaf][s] = makeQueue(QueueType, LEAF_SPEED, LEAF_BUFFER, nullptr, qn, logfile);
-                string pn = "pipe_L" + to_string(leaf) + "_S" + to_string(gsid) + "_down";
-                topo.leafToServerP[leaf][s] = new Pipe(timeFromUs(LINK_DELAY_US));
-                topo.leafToServerP[leaf][s]->setName(pn); logfile.writeName(*topo.leafToServerP[leaf][s]);
-            }
-            topo.leafSwitches[leaf]->addDownlink(gsid, topo.leafToServerQ[leaf][s], topo.leafToServerP[leaf][s]);
-        }
+    if (LinkEvents != "") {
+        new LinkSchedule(*topo, LinkEvents);
     }
 
     // Flow generator
     DataSource::EndHost eh = DataSource::TCP;
     if (EndHost == "dctcp") eh = DataSource::DCTCP;
+    if (EndHost == "cubic") eh = DataSource::CUBIC;
+    if (EndHost == "homa")  eh = DataSource::HOMA;
+    if (EndHost == "hpcc")  eh = DataSource::HPCC;
+    if (EndHost == "swift") eh = DataSource::SWIFT;
 
-    Workloads::FlowDist fd = Workloads::UNIFORM;
-    if (FlowDist == "pareto") fd = Workloads::PARETO;
-    else if (FlowDist == "datamining") fd = Workloads::DATAMINING;
-    else if (FlowDist == "enterprise") {
-        // If the tree has ENTERPRISE, use it; otherwise map to PARETO:
-        #ifdef WORKLOADS_HAS_ENTERPRISE
-        fd = Workloads::ENTERPRISE;
-        #else
-        fd = Workloads::PARETO;
-        #endif
-    }
-
-    const uint64_t TOTAL_HOST_LINKS = (uint64_t)N_LEAF * (uint64_t)N_SERVER;
+    const uint64_t TOTAL_HOST_LINKS = topo->nHosts();
+    const linkspeed_bps LEAF_SPEED = topo->speed(Topology::HOST_UP);
     const long double totalCapacity = (long double)TOTAL_HOST_LINKS * (long double)LEAF_SPEED;
     linkspeed_bps flowRate = llround(totalCapacity * Util);
     flowRate = llround(flowRate * 0.01);
 
-    auto *flowGen = new FlowGenerator(eh, route_gen, flowRate, AvgFlowSize, fd);
-    flowGen->setEndhostQueue(LEAF_SPEED, ENDH_BUFFER);
-    flowGen->setPrefix(g_policy + "-");
-    flowGen->setTimeLimits(0, timeFromSec(Duration)); 
+    LoadSchedule *schedule = NULL;
+    if (Schedule != "") {
+        schedule = new LoadSchedule(Schedule, LoadRamp != 0);
+    }
+
+    ConvergenceMonitor *monitor = NULL;
+    if (Converge > 0) {
+        monitor = new ConvergenceMonitor(*topo, timeFromMs(ConvergeMs), Converge);
+    }
+
+    // Endhost settings shared by every generator.
+    auto configure = [&](FlowGenerator *gen) {
+        if (Nic == "") {
+            gen->setEndhostQueue(LEAF_SPEED, ENDH_BUFFER);
+        } else {
+            HostNic::Scheduler sched = HostNic::FIFO;
+            if (Nic == "rr") sched = HostNic::RR;
+            if (Nic == "srpt") sched = HostNic::SRPT;
+            gen->setHostNic(LEAF_SPEED, ENDH_BUFFER, sched);
+        }
+        gen->setReorderTolerance(Rack != 0);
+        gen->setDelayedAck(DelAck, timeFromUs(DelAckUs));
+        gen->setSack(Sack != 0);
+        gen->setPacing(Pacing);
+        gen->setConnectionPool(ConnPool != 0);
+        gen->setMonitor(monitor);
+        if (schedule != NULL) {
+            gen->setLoadSchedule(schedule, Util);
+        }
+        gen->setTimeLimits(0, timeFromSec(Duration));
+    };
+
+    // Each traffic pattern runs its own generator with its share of the
+    // load, and random flows take the rest.
+    double randomShare = 1;
+    for (auto &pattern : TrafficMatrix::parseList(Traffic)) {
+        auto *patternGen = new FlowGenerator(eh, route_gen, llround(flowRate * pattern.second),
+                AvgFlowSize, FlowDist);
+        patternGen->setTrafficMatrix(TrafficMatrix::create(pattern.first, *topo, args));
+        patternGen->setPrefix(g_policy + "-" + pattern.first + "-");
+        configure(patternGen);
+        randomShare -= pattern.second;
+    }
+
+    if (randomShare > 0) {
+        auto *flowGen = new FlowGenerator(eh, route_gen, llround(flowRate * randomShare),
+                AvgFlowSize, FlowDist);
+        if (Trace != "") {
+            flowGen->setTrace(Trace);
+        } else if (HostArr != 0) {
+            flowGen->setHostArrivals(topo->nHosts(), topo->hostsPerRack(), LocalRatio, Partitions);
+            flowGen->setRackLoads(RackLoad);
+        } else if (Rpc != 0) {
+            flowGen->setRpc(topo->nHosts(), Rpc, RpcRequest);
+        } else if (Batch != 0) {
+            flowGen->setBatchArrivals(Batch, topo->nHosts());
+        }
+        flowGen->setPrefix(g_policy + "-");
+        configure(flowGen);
+    }
+
+    if (schedule != NULL) {
+        schedule->start(timeFromSec(Duration));
+        if (monitor != NULL) {
+            monitor->atStop([schedule] {schedule->report();});
+        }
+    }
+    if (monitor != NULL) {
+        monitor->start(0, timeFromSec(Duration));
+    }
 
     EventList::Get().setEndtime(timeFromSec(Duration));
 }
@@ -12,7 +12,7 @@ namespace linksim {
     route_t routeFwd;
     route_t routeRev;
 
-    void generateRoute(route_t *&fwd, route_t *&rev, uint32_t &src, uint32_t &dst);
+    void generateRoute(const route_t *&fwd, const route_t *&rev, uint32_t &src, uint32_t &dst);
 }
 
 using namespace std;
@@ -32,6 +32,13 @@ void single_link_simulation(const ArgList &args, Logfile &logfile)
     string QueueType = "droptail";    // Queue type (droptail/fq/afq)
     string EndHost = "tcp";           // Endhost type (tcp/pp)
     string Trace = "";                // File containing trace to replay.
+    uint32_t DelAck = 1;              // Segments per ACK (1 = no delayed ACKs).
+    double DelAckUs = 10;             // Delayed ACK timeout (us).
+    uint32_t Sack = 0;                // SACK + RACK-TLP loss recovery.
+    uint32_t Pacing = 0;              // TCP pacing burst in segments (0 = off).
+    string Nic = "";                  // Shared host NIC: fifo/rr/srpt ("" = queue per flow).
+    string Schedule = "";             // Load over time, e.g. 0:0.1,2:0.5 (see LoadSchedule).
+    uint32_t LoadRamp = 0;            // Ramp between schedule points instead of steps.
     struct AFQcfg afqcfg;             // AFQ config.
 
     parseInt(args, "duration", Duration);
@@ -46,6 +53,13 @@ void single_link_simulation(const ArgList &args, Logfile &logfile)
     parseString(args, "queue", QueueType);
     parseString(args, "endhost", EndHost);
     parseString(args, "trace", Trace);
+    parseInt(args, "delack", DelAck);
+    parseDouble(args, "delacktimeout", DelAckUs);
+    parseInt(args, "sack", Sack);
+    parseInt(args, "pacing", Pacing);
+    parseString(args, "nic", Nic);
+    parseString(args, "loadschedule", Schedule);
+    parseInt(args, "loadramp", LoadRamp);
     parseInt(args, "afqH", afqcfg.nHash);
     parseInt(args, "afqB", afqcfg.nBucket);
     parseInt(args, "afqQ", afqcfg.nQueue);
@@ -92,7 +106,6 @@ void single_link_simulation(const ArgList &args, Logfile &logfile)
     routeRev.push_back(pipeRev);
 
     DataSource::EndHost eh = DataSource::TCP;
-    Workloads::FlowDist fd  = Workloads::UNIFORM;
 
     if (EndHost == "pp") {
         eh = DataSource::PKTPAIR;
@@ -100,14 +113,14 @@ void single_link_simulation(const ArgList &args, Logfile &logfile)
         eh = DataSource::TIMELY;
     } else if (EndHost == "dctcp") {
         eh = DataSource::DCTCP;
-    }
-
-    if (FlowDist == "pareto") {
-        fd = Workloads::PARETO;
-    } else if (FlowDist == "enterprise") {
-        fd = Workloads::ENTERPRISE;
-    } else if (FlowDist == "datamining") {
-        fd = Workloads::DATAMINING;
+    } else if (EndHost == "cubic") {
+        eh = DataSource::CUBIC;
+    } else if (EndHost == "homa") {
+        eh = DataSource::HOMA;
+    } else if (EndHost == "hpcc") {
+        eh = DataSource::HPCC;
+    } else if (EndHost == "swift") {
+        eh = DataSource::SWIFT;
     }
 
     /* Configure flow generator. */
@@ -116,7 +129,7 @@ void single_link_simulation(const ArgList &args, Logfile &logfile)
         flowRate = LinkSpeed;
     }
 
-    FlowGenerator *flowGen = new FlowGenerator(eh, generateRoute, flowRate, AvgFlowSize, fd);
+    FlowGenerator *flowGen = new FlowGenerator(eh, generateRoute, flowRate, AvgFlowSize, FlowDist);
 
     if (MaxFlows != 0) {
         flowGen->setReplaceFlow(MaxFlows, OnOffRatio);
@@ -126,18 +139,37 @@ void single_link_simulation(const ArgList &args, Logfile &logfile)
         flowGen->setTrace(Trace);
     }
 
-    flowGen->setEndhostQueue(LinkSpeed, 8192000);
+    if (Nic == "") {
+        flowGen->setEndhostQueue(LinkSpeed, 8192000);
+    } else {
+        HostNic::Scheduler sched = HostNic::FIFO;
+        if (Nic == "rr") {
+            sched = HostNic::RR;
+        } else if (Nic == "srpt") {
+            sched = HostNic::SRPT;
+        }
+        flowGen->setHostNic(LinkSpeed, 8192000, sched);
+    }
+    flowGen->setDelayedAck(DelAck, timeFromUs(DelAckUs));
+    flowGen->setSack(Sack != 0);
+    flowGen->setPacing(Pacing);
     flowGen->setTimeLimits(0, timeFromSec(Duration) - 1);
 
+    if (Schedule != "") {
+        LoadSchedule *schedule = new LoadSchedule(Schedule, LoadRamp != 0);
+        flowGen->setLoadSchedule(schedule, Utilization);
+        schedule->start(timeFromSec(Duration) - 1);
+    }
+
 
     EventList::Get().setEndtime(timeFromSec(Duration));
 }
 
 void
-linksim::generateRoute(route_t *&fwd, route_t *&rev, uint32_t &src, uint32_t &dst)
+linksim::generateRoute(const route_t *&fwd, const route_t *&rev, uint32_t &src, uint32_t &dst)
 {
-    fwd = new route_t(routeFwd);
-    rev = new route_t(routeRev);
+    fwd = &routeFwd;
+    rev = &routeRev;
     src = 0;
     dst = 1;
 }
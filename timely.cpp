@@ -8,6 +8,7 @@ using namespace std;
 TimelySrc::TimelySrc(TrafficLogger *pktlogger,
         uint64_t flowsize, simtime_picosec duration)
     : DataSource(pktlogger, flowsize, duration),
+      _pacer(NULL),
       _state(IDLE),
       _recover_seq(0),
       _dupacks(0),
@@ -24,7 +25,11 @@ TimelySrc::TimelySrc(TrafficLogger *pktlogger,
       _rtt_gradient(0.0),
       _last_rtt_update(0),
       _last_rtt_bytes(0),
-      _measured_rate(0)
+      _measured_rate(0),
+      _next_send(0),
+      _pace_pending(false),
+      _timer_at(0),
+      _timer_events(0)
 {
     // Constructor
 }
@@ -59,28 +64,48 @@ TimelySrc::doNextEvent()
              << timeAsUs(_rto_timeout) << " " << _flow._nPackets << endl;
     }
 
-    // If this is the first transmission, send a packet-pair, set rto and return.
+    // If this is the first transmission, start sending through the pacer.
     if (_state == IDLE) {
         _highest_sent = 0;
         _last_acked = 0;
         _bdp_estimate = 8 * MSS_BYTES;
         _last_rtt_update = current_ts;
         _state = NORMAL;
+
+        _next_send = current_ts;
+        pacedSend();
+        return;
     }
 
-    // Cleanup the finished flow.
-    else if (_state == FINISH) {
-        if (_flow._nPackets == 0) {
+    _timer_events--;
+
+    // Cleanup the finished flow once nothing refers to it.
+    if (_state == FINISH) {
+        if (_timer_events > 0) {
+            return;
+        }
+        if (_flow._nPackets == 0 && !_pace_pending) {
             delete _sink;
-            delete _route_fwd;
-            delete _route_rev;
+            delete _endhost_queue;
             delete this;
             return;
         }
+
+        // Woken again by the last packet of the flow, or the pacer,
+        // through an event counted as a timer one.
+        _timer_events++;
+        _flow.setWaiter(this);
+        return;
+    }
+
+    // Superseded by an earlier deadline.
+    if (current_ts != _timer_at) {
+        return;
     }
+    _timer_at = 0;
 
     // Retransmission timeout.
-    else if (_rto_timeout != 0 && current_ts >= _rto_timeout) {
+    if (_rto_timeout != 0 && current_ts >= _rto_timeout) {
 
         cout << str() << " at " << timeAsMs(current_ts)
              << " RTO " << timeAsUs(_rto)
@@ -98,21 +123,91 @@ TimelySrc::doNextEvent()
         _rto *= 2;
         _rto_timeout = current_ts + _rto;
 
+        refreshRoutes();
         retransmitPacket(current_ts);
+        resume(current_ts);
+    }
+
+    armTimer(_rto_timeout);
+}
+
+void
+TimelySrc::pacedSend()
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    _pace_pending = false;
+
+    if (_state == FINISH) {
+        _flow.wake();
+        return;
+    }
+    if (!sendPackets(current_ts)) {
+        return;
+    }
+
+    // Time to transmit MSS_BYTES at the current rate, from the ideal send
+    // time unless the pacer has fallen a whole packet behind it.
+    simtime_picosec gap = timeFromSec((MSS_BYTES * 8.0)/_rate);
+    if (_next_send + gap > current_ts) {
+        _next_send += gap;
+    } else {
+        _next_send = current_ts + gap;
+    }
+
+    _pace_pending = true;
+    _pacer->schedule(*this, _next_send);
+    armTimer(_rto_timeout);
+}
+
+void
+TimelySrc::resume(simtime_picosec current_ts)
+{
+    if (_pace_pending || _state == FINISH) {
+        return;
     }
 
-    if (_state != FINISH) {
-        sendPackets(current_ts);
-    } 
+    if (current_ts >= _next_send) {
+        pacedSend();
+    } else {
+        _pace_pending = true;
+        _pacer->schedule(*this, _next_send);
+    }
+}
 
-    /* Schedule next transmission. Time to transmit MSS_BYTES at estimated link rate. */
-    simtime_picosec nextTransmission = timeFromSec((MSS_BYTES * 8.0)/_rate);
+void
+TimelySrc::armTimer(simtime_picosec when)
+{
+    if (when == 0 || (_timer_at != 0 && _timer_at <= when)) {
+        return;
+    }
 
-    EventList::Get().sourceIsPendingRel(*this, nextTransmission);
+    _timer_at = when;
+    _timer_events++;
+    EventList::Get().sourceIsPending(*this, when);
 }
 
 void
-TimelySrc::receivePacket(Packet& pkt)
+TimelySrc::receivePacket(Packet &pkt)
+{
+    simtime_picosec current_ts = EventList::Get().now();
+    receiveAck(pkt);
+
+    // Have the flow event clean up once the flow is done.
+    if (_state == FINISH) {
+        if (_timer_events == 0) {
+            _timer_at = 0;
+            armTimer(current_ts + max(_rtt, timeFromUs(MIN_RTO_US)));
+        }
+        return;
+    }
+
+    // The ack may have opened the window of a flow that stopped sending.
+    resume(current_ts);
+    armTimer(_rto_timeout);
+}
+
+void
+TimelySrc::receiveAck(Packet& pkt)
 {
     simtime_picosec current_ts = EventList::Get().now();
     DataAck *p = (DataAck*)(&pkt);
@@ -298,17 +393,17 @@ TimelySrc::receivePacket(Packet& pkt)
     }
 }
 
-void
+bool
 TimelySrc::sendPackets(simtime_picosec current_ts)
 {
     // Don't send more packets it we have already sent _flowsize bytes.
     if (_flowsize != 0 && _highest_sent >= _flowsize) {
-        return;
+        return false;
     }
 
     // Don't send more packets if we have more than BDP bytes in flight.
     if (_bdp_estimate != 0 && _highest_sent - _last_acked >= (_bdp_estimate + _bdp_estimate / 2 + _dupacks * MSS_BYTES)) {
-        return;
+        return false;
     }
 
     if (TRACE_FLOW == str()) {
@@ -317,7 +412,7 @@ TimelySrc::sendPackets(simtime_picosec current_ts)
     }
 
     DataPacket *p;
-    p = DataPacket::newpkt(_flow, *_route_fwd, _highest_sent + 1, MSS_BYTES);
+    p = DataPacket::newpkt(_flow, _route_fwd, _highest_sent + 1, MSS_BYTES);
     p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
     p->set_ts(current_ts);
     p->sendOn();
@@ -328,6 +423,7 @@ TimelySrc::sendPackets(simtime_picosec current_ts)
     if (_rto_timeout == 0) {
         _rto_timeout = current_ts + _rto;
     }
+    return true;
 }
 
 void
@@ -338,7 +434,7 @@ TimelySrc::retransmitPacket(simtime_picosec current_ts)
     }
 
     DataPacket *p;
-    p = DataPacket::newpkt(_flow, *_route_fwd, _last_acked + 1, MSS_BYTES);
+    p = DataPacket::newpkt(_flow, _route_fwd, _last_acked + 1, MSS_BYTES);
     p->flow().logTraffic(*p, *this, TrafficLogger::PKT_CREATESEND);
     p->set_ts(current_ts);
 
@@ -372,7 +468,7 @@ TimelySink::receivePacket(Packet& pkt)
         cout << str() << " SINK-TS: " << timeAsMs(EventList::Get().now()) << " at " << seqno << endl;
     }
 
-    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, 1, _cumulative_ack);
+    DataAck *ack = DataAck::newpkt(_src->_flow, *_route, 1, cumulative_ack());
     ack->flow().logTraffic(*ack, *this, TrafficLogger::PKT_CREATESEND);
     ack->set_ts(ts);
     ack->sendOn();
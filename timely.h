@@ -3,6 +3,7 @@
 
 #include "eventlist.h"
 #include "datasource.h"
+#include "pacer.h"
 
 #define T_LOW timeFromUs(20)
 #define T_HIGH timeFromUs(100)
@@ -13,7 +14,13 @@
 class TimelySink;
 class FlowGenerator;
 
-class TimelySrc : public DataSource
+/*
+ * TIMELY sender. Packets are sent one at a time at _rate, released by the
+ * pacer of the sending host, which serves all of its TIMELY flows. A flow
+ * with a full window leaves the pacer until an ack opens the window again,
+ * and the flow's own event only runs the retransmission timer.
+ */
+class TimelySrc : public DataSource, public PacedSource, public Pooled<TimelySrc>
 {
 friend class TimelySink;
 public:
@@ -23,6 +30,10 @@ public:
     void printStatus();
     void doNextEvent();
     void receivePacket(Packet &pkt);
+    void pacedSend();
+
+    // Pacer of the sending host; must be set before the flow starts.
+    HostPacer *_pacer;
 
     // Flow status.
     enum FlowStatus {
@@ -55,11 +66,26 @@ public:
     linkspeed_bps _measured_rate;
 
 private:
-    void sendPackets(simtime_picosec current_ts);
+    void receiveAck(Packet &pkt);
+    bool sendPackets(simtime_picosec current_ts);
     void retransmitPacket(simtime_picosec current_ts);
+
+    // Puts the flow back on the pacer if it has stopped sending.
+    void resume(simtime_picosec current_ts);
+
+    // Schedules the flow's own event for the RTO, or for cleanup.
+    void armTimer(simtime_picosec when);
+
+    simtime_picosec _next_send;     // Ideal time of the next packet.
+    bool _pace_pending;             // On the pacer.
+
+    // The flow event can't be cancelled: only the one due at _timer_at
+    // is acted on, and the flow is freed once none are pending.
+    simtime_picosec _timer_at;
+    uint32_t _timer_events;
 };
 
-class TimelySink : public DataSink
+class TimelySink : public DataSink, public Pooled<TimelySink>
 {
 friend class TimelySrc;
 public:
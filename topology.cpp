@@ -0,0 +1,693 @@
+/*
+ * Topology builder
+ */
+#include "topology.h"
+#include "fairqueue.h"
+#include "priorityqueue.h"
+#include "aprx-fairqueue.h"
+#include "stoc-fairqueue.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+uint32_t Topology::_routeEpoch = 0;
+
+static Queue*
+defaultQueue(const string &qtype,
+             linkspeed_bps speed,
+             mem_b buffer)
+{
+    if (qtype == "fq") {
+        return new FairQueue(speed, buffer, NULL);
+    } else if (qtype == "pq") {
+        return new PriorityQueue(speed, buffer, NULL);
+    } else if (qtype == "sfq") {
+        return new StocFairQueue(speed, buffer, NULL);
+    } else if (qtype == "afq") {
+        return new AprxFairQueue(speed, buffer, NULL);
+    } else {
+        return new Queue(speed, buffer, NULL); // droptail
+    }
+}
+
+// Reads key=value lines into args, skipping blank lines and # comments.
+static void
+loadTopoFile(const string &filename,
+             ArgList &args)
+{
+    ifstream in(filename.c_str());
+    if (!in) {
+        cerr << "Error opening topology file: " << filename << endl;
+        exit(1);
+    }
+
+    string line;
+    while (getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t eq = line.find('=');
+        if (eq == string::npos) {
+            continue;
+        }
+
+        string key = line.substr(0, eq);
+        string val = line.substr(eq + 1);
+        key.erase(0, key.find_first_not_of(" \t"));
+        key.erase(key.find_last_not_of(" \t\r") + 1);
+        val.erase(0, val.find_first_not_of(" \t"));
+        val.erase(val.find_last_not_of(" \t\r") + 1);
+        args[key] = val;
+    }
+}
+
+Topology*
+Topology::create(const ArgList &defaults,
+                 const ArgList &args)
+{
+    // Command line overrides the topology file, which overrides defaults.
+    ArgList topoArgs = defaults;
+
+    string topoFile;
+    if (parseString(args, "topofile", topoFile)) {
+        loadTopoFile(topoFile, topoArgs);
+    }
+    for (auto const &arg : args) {
+        topoArgs[arg.first] = arg.second;
+    }
+
+    string type = "leafspine";
+    parseString(topoArgs, "topo", type);
+
+    Topology *topo;
+    if (type == "leafspine") {
+        topo = new LeafSpineTopology();
+    } else if (type == "clos") {
+        topo = new ClosTopology();
+    } else {
+        cerr << "Unknown topology type: " << type << endl;
+        exit(1);
+    }
+
+    topo->_type = type;
+    topo->configure(topoArgs);
+    return topo;
+}
+
+Topology::Topology()
+    : _nServer(32),
+    _nHosts(0),
+    _oversub(0),
+    _names(true),
+    _lazy(true),
+    _linkDelay(timeFromUs(1)),
+    _logfile(NULL),
+    _nBuilt(0)
+{
+    for (int lc = 0; lc <= N_LINK_CLASSES; lc++) {
+        _base[lc] = 0;
+    }
+}
+
+void
+Topology::configure(const ArgList &args)
+{
+    double hostSpeed = 10, edgeSpeed = 40, coreSpeed = 40; // Gbps
+    double linkDelay = 1;                                   // us
+    uint32_t names = 1;
+    uint32_t lazy = 1;
+    string queueType = "droptail";
+
+    parseInt(args, "nserver", _nServer);
+    parseDouble(args, "oversub", _oversub);
+    parseDouble(args, "hostspeed", hostSpeed);
+    parseDouble(args, "edgespeed", edgeSpeed);
+    parseDouble(args, "corespeed", coreSpeed);
+    parseDouble(args, "linkdelay", linkDelay);
+    parseInt(args, "names", names);
+    parseInt(args, "lazy", lazy);
+    parseString(args, "queue", queueType);
+
+    _linkDelay = timeFromUs(linkDelay);
+    _names = (names != 0);
+    _lazy = (lazy != 0);
+
+    _speed[HOST_UP] = _speed[HOST_DOWN] = speedFromGbps(hostSpeed);
+    _speed[EDGE_UP] = _speed[EDGE_DOWN] = speedFromGbps(edgeSpeed);
+    _speed[CORE_UP] = _speed[CORE_DOWN] = speedFromGbps(coreSpeed);
+
+    const char *bufKey[N_LINK_CLASSES] = {
+        "buf_hostup", "buf_hostdown", "buf_edgeup", "buf_edgedown", "buf_coreup", "buf_coredown"
+    };
+    for (int lc = 0; lc < N_LINK_CLASSES; lc++) {
+        uint64_t buffer = 1024000;
+        parseLongInt(args, bufKey[lc], buffer);
+        _buffer[lc] = buffer;
+        _qtype[lc] = queueType;
+    }
+
+    // The server uplink models the NIC and may use its own queue type.
+    parseString(args, "hostqueue", _qtype[HOST_UP]);
+}
+
+void
+Topology::layout(const uint32_t *count)
+{
+    _base[0] = 0;
+    for (int lc = 0; lc < N_LINK_CLASSES; lc++) {
+        _base[lc + 1] = _base[lc] + count[lc];
+    }
+}
+
+Topology::LinkClass
+Topology::linkClass(uint32_t link) const
+{
+    assert(link < nLinks());
+
+    int lc = 0;
+    while (link >= _base[lc + 1]) {
+        lc++;
+    }
+    return (LinkClass)lc;
+}
+
+void
+Topology::build(queue_factory_t factory)
+{
+    _factory = factory ? factory : defaultQueue;
+
+    _queues.assign(nLinks(), NULL);
+    _pipes.assign(nLinks(), NULL);
+    _down.assign(nLinks(), false);
+    if (_lazy) {
+        _proxies.reserve(2 * (nLinks(HOST_UP) + nLinks(HOST_DOWN)));
+        _proxyRoutes.resize(nLinks(HOST_UP) + nLinks(HOST_DOWN));
+    }
+
+    for (int lc = 0; lc < N_LINK_CLASSES; lc++) {
+        bool deferred = _lazy && (lc == HOST_UP || lc == HOST_DOWN);
+
+        for (uint32_t link = _base[lc]; link < _base[lc + 1]; link++) {
+            if (deferred) {
+                _proxies.emplace_back(this, link, false);
+                _proxies.emplace_back(this, link, true);
+            } else {
+                instantiate(link);
+            }
+        }
+    }
+}
+
+void
+Topology::instantiate(uint32_t link)
+{
+    assert(_queues[link] == NULL);
+
+    LinkClass lc = linkClass(link);
+    _queues[link] = _factory(_qtype[lc], _speed[lc], _buffer[lc]);
+    _pipes[link] = new Pipe(_linkDelay);
+    _nBuilt++;
+
+    // Interned hop lists take the link in place of its proxies. Packets
+    // look up their next hop as they go, so those in flight follow suit.
+    if (_lazy && (lc == HOST_UP || lc == HOST_DOWN)) {
+        uint32_t p = 2 * (link - _base[HOST_UP]);
+        vector<route_t*> &routes = _proxyRoutes[link - _base[HOST_UP]];
+        for (route_t *hops : routes) {
+            for (PacketSink *&hop : *hops) {
+                if (hop == &_proxies[p]) {
+                    hop = _queues[link];
+                } else if (hop == &_proxies[p + 1]) {
+                    hop = _pipes[link];
+                }
+            }
+        }
+        vector<route_t*>().swap(routes);
+    }
+
+    // Links built after writeNames() are named as they appear.
+    if (_names && _logfile) {
+        nameLink(link, _logfile);
+    }
+}
+
+void
+LinkProxy::receivePacket(Packet &pkt)
+{
+    if (!_topo->built(_link)) {
+        _topo->instantiate(_link);
+    }
+
+    if (_pipe) {
+        _topo->pipe(_link)->receivePacket(pkt);
+    } else {
+        _topo->queue(_link)->receivePacket(pkt);
+    }
+}
+
+const route_t*
+Topology::route(uint32_t src,
+                uint32_t dst,
+                uint32_t path)
+{
+    // Within a rack the path is unused, so all of them share one route.
+    if (rack(src) == rack(dst)) {
+        path = 0;
+    }
+
+    uint64_t key = ((uint64_t)src * _nHosts + dst) * nPaths() + path;
+    auto it = _routes.find(key);
+    if (it != _routes.end()) {
+        return it->second.hops;
+    }
+
+    InternedRoute &r = _routes[key];
+    r.live = livePath(src, dst, path);
+    _hopLists.emplace_back();
+    r.hops = &_hopLists.back();
+    internHops(*r.hops, src, dst, r.live);
+    return r.hops;
+}
+
+void
+Topology::internHops(route_t &hops,
+                     uint32_t src,
+                     uint32_t dst,
+                     uint32_t path)
+{
+    uint32_t links[MAX_PATH_LINKS];
+    uint32_t n = pathLinks(src, dst, path, links);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (_queues[links[i]] == NULL) {
+            _proxyRoutes[links[i] - _base[HOST_UP]].push_back(&hops);
+        }
+        appendLink(hops, links[i]);
+    }
+    hops.shrink_to_fit();
+}
+
+void
+Topology::appendRoute(route_t &route,
+                      uint32_t src,
+                      uint32_t dst,
+                      uint32_t path) const
+{
+    uint32_t links[MAX_PATH_LINKS];
+    uint32_t n = pathLinks(src, dst, path, links);
+
+    for (uint32_t i = 0; i < n; i++) {
+        appendLink(route, links[i]);
+    }
+}
+
+bool
+Topology::pathUp(uint32_t src,
+                 uint32_t dst,
+                 uint32_t path) const
+{
+    uint32_t links[MAX_PATH_LINKS];
+    uint32_t n = pathLinks(src, dst, path, links);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (_down[links[i]]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t
+Topology::livePath(uint32_t src,
+                   uint32_t dst,
+                   uint32_t path) const
+{
+    for (uint32_t i = 0; i < nPaths(); i++) {
+        uint32_t p = (path + i) % nPaths();
+        if (pathUp(src, dst, p)) {
+            return p;
+        }
+    }
+
+    // Nothing is up, e.g. a failed server link; stay on the dead path.
+    return path;
+}
+
+void
+Topology::reroute()
+{
+    bool moved = false;
+
+    for (auto &route : _routes) {
+        uint64_t key = route.first;
+        uint32_t path = key % nPaths();
+        uint32_t dst = (key / nPaths()) % _nHosts;
+        uint32_t src = key / nPaths() / _nHosts;
+
+        // Only routes whose live path crosses the changed link move.
+        uint32_t live = livePath(src, dst, path);
+        if (live == route.second.live) {
+            continue;
+        }
+
+        // Packets in flight keep the old hop list; it is never freed.
+        _hopLists.emplace_back();
+        route_t &hops = _hopLists.back();
+        internHops(hops, src, dst, live);
+        route.second.live = live;
+        route.second.hops = &hops;
+        moved = true;
+    }
+
+    if (moved) {
+        _routeEpoch++;
+    }
+}
+
+bool
+Topology::findLink(const string &name,
+                   uint32_t &link) const
+{
+    for (uint32_t l = 0; l < nLinks(); l++) {
+        if (linkName(l) == name) {
+            link = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+Topology::setLinkRate(uint32_t link,
+                      linkspeed_bps speed)
+{
+    if (!built(link)) {
+        instantiate(link);
+    }
+    _queues[link]->setBitrate(speed);
+}
+
+void
+Topology::setLinkUp(uint32_t link,
+                    bool up)
+{
+    if (!built(link)) {
+        instantiate(link);
+    }
+    _pipes[link]->setFailed(!up);
+    _down[link] = !up;
+
+    reroute();
+}
+
+void
+Topology::nameLink(uint32_t link,
+                   Logfile *logfile)
+{
+    _queues[link]->setName(linkName(link));
+    _pipes[link]->setName(pipeName(link));
+
+    if (logfile) {
+        logfile->writeName(*_queues[link]);
+        logfile->writeName(*_pipes[link]);
+    }
+}
+
+void
+Topology::writeNames(Logfile &logfile)
+{
+    if (!_names) {
+        return;
+    }
+
+    _logfile = &logfile;
+    for (uint32_t link = 0; link < nLinks(); link++) {
+        if (built(link)) {
+            nameLink(link, &logfile);
+        }
+    }
+}
+
+void
+Topology::printSummary()
+{
+    cerr << "Topology " << _type << ": " << _nHosts << " hosts, "
+         << nLinks() << " links (" << nLinks() - _nBuilt << " deferred), oversubscription " << setprecision(3) << _oversub << endl;
+}
+
+
+void
+LeafSpineTopology::configure(const ArgList &args)
+{
+    Topology::configure(args);
+
+    _nLeaf = 24;
+    _nSpine = 12;
+    parseInt(args, "nleaf", _nLeaf);
+    parseInt(args, "nspine", _nSpine);
+
+    double hostBw = (double)_nServer * _speed[HOST_UP];
+    if (_oversub > 0) {
+        _nSpine = (uint32_t)ceil(hostBw / (_oversub * _speed[EDGE_UP]));
+    }
+    _oversub = hostBw / ((double)_nSpine * _speed[EDGE_UP]);
+    _nHosts = _nLeaf * _nServer;
+
+    uint32_t count[N_LINK_CLASSES] = {
+        _nHosts, _nHosts, _nLeaf * _nSpine, _nSpine * _nLeaf, 0, 0
+    };
+    layout(count);
+}
+
+uint32_t
+LeafSpineTopology::pathLinks(uint32_t src,
+                             uint32_t dst,
+                             uint32_t path,
+                             uint32_t *links) const
+{
+    uint32_t srcLeaf = rack(src);
+    uint32_t dstLeaf = rack(dst);
+    uint32_t n = 0;
+
+    links[n++] = hostUp(src);
+    if (srcLeaf != dstLeaf) {
+        links[n++] = leafUp(srcLeaf, path);
+        links[n++] = spineDown(path, dstLeaf);
+    }
+    links[n++] = hostDown(dst);
+    return n;
+}
+
+string
+LeafSpineTopology::linkName(uint32_t link) const
+{
+    char name[64];
+    uint32_t i = link - _base[linkClass(link)];
+
+    switch (linkClass(link)) {
+        case HOST_UP:
+            snprintf(name, sizeof(name), "S%u_L%u_up", i, rack(i));
+            break;
+        case HOST_DOWN:
+            snprintf(name, sizeof(name), "L%u_S%u_down", rack(i), i);
+            break;
+        case EDGE_UP:
+            snprintf(name, sizeof(name), "L%u_C%u_up", i / _nSpine, i % _nSpine);
+            break;
+        default: // EDGE_DOWN
+            snprintf(name, sizeof(name), "C%u_L%u_down", i / _nLeaf, i % _nLeaf);
+    }
+    return name;
+}
+
+string
+LeafSpineTopology::pipeName(uint32_t link) const
+{
+    return "pipe_" + linkName(link);
+}
+
+
+void
+ClosTopology::configure(const ArgList &args)
+{
+    Topology::configure(args);
+
+    _nPod = 4;
+    _nTor = 2;
+    _nAgg = 2;
+    _nUplink = 2;
+    parseInt(args, "npod", _nPod);
+    parseInt(args, "ntor", _nTor);
+    parseInt(args, "nagg", _nAgg);
+    parseInt(args, "nuplink", _nUplink);
+
+    double hostBw = (double)_nServer * _speed[HOST_UP];
+    if (_oversub > 0) {
+        _nAgg = (uint32_t)ceil(hostBw / (_oversub * _speed[EDGE_UP]));
+    }
+    _oversub = hostBw / ((double)_nAgg * _speed[EDGE_UP]);
+    _nHosts = _nPod * _nTor * _nServer;
+
+    uint32_t nEdge = _nPod * _nAgg * _nTor;
+    uint32_t nCore = _nPod * _nAgg * _nUplink;
+    uint32_t count[N_LINK_CLASSES] = {_nHosts, _nHosts, nEdge, nEdge, nCore, nCore};
+    layout(count);
+}
+
+uint32_t
+ClosTopology::pathLinks(uint32_t src,
+                        uint32_t dst,
+                        uint32_t path,
+                        uint32_t *links) const
+{
+    uint32_t src_pod = src / (_nTor * _nServer);
+    uint32_t dst_pod = dst / (_nTor * _nServer);
+    uint32_t src_tor = rack(src) % _nTor;
+    uint32_t dst_tor = rack(dst) % _nTor;
+    uint32_t agg     = path / _nUplink;
+    uint32_t uplink  = path % _nUplink;
+    uint32_t n = 0;
+
+    links[n++] = hostUp(src);
+
+    if (rack(src) != rack(dst)) {
+        links[n++] = torAgg(src_pod, agg, src_tor);
+
+        if (src_pod != dst_pod) {
+            links[n++] = aggCore(src_pod, agg, uplink);
+            links[n++] = coreAgg(dst_pod, agg, uplink);
+        }
+
+        links[n++] = aggTor(dst_pod, agg, dst_tor);
+    }
+
+    links[n++] = hostDown(dst);
+    return n;
+}
+
+void
+ClosTopology::linkIndices(uint32_t link,
+                          uint32_t &i,
+                          uint32_t &j,
+                          uint32_t &k) const
+{
+    LinkClass lc = linkClass(link);
+    uint32_t idx = link - _base[lc];
+
+    if (lc == HOST_UP || lc == HOST_DOWN) {
+        // [pod][tor][server]
+        i = idx / (_nTor * _nServer);
+        j = (idx / _nServer) % _nTor;
+        k = idx % _nServer;
+    } else {
+        // [pod][agg][tor] or [pod][agg][uplink]
+        uint32_t n = (lc == EDGE_UP || lc == EDGE_DOWN) ? _nTor : _nUplink;
+        i = idx / (_nAgg * n);
+        j = (idx / n) % _nAgg;
+        k = idx % n;
+    }
+}
+
+static const char *closLinkNames[Topology::N_LINK_CLASSES] = {
+    "server-tor", "tor-server", "tor-agg", "agg-tor", "agg-core", "core-agg"
+};
+
+string
+ClosTopology::linkName(uint32_t link) const
+{
+    char name[64];
+    uint32_t i, j, k;
+    linkIndices(link, i, j, k);
+    snprintf(name, sizeof(name), "q-%s-%u-%u-%u", closLinkNames[linkClass(link)], i, j, k);
+    return name;
+}
+
+string
+ClosTopology::pipeName(uint32_t link) const
+{
+    return "p" + linkName(link).substr(1);
+}
+
+
+// Parses a time such as "2s", "1.5ms" or "300" (us).
+static simtime_picosec
+parseTime(const string &s)
+{
+    size_t end;
+    double val = stod(s, &end);
+    string unit = s.substr(end);
+
+    if (unit == "s") {
+        return timeFromSec(val);
+    } else if (unit == "ms") {
+        return timeFromMs(val);
+    }
+    return timeFromUs(val);
+}
+
+LinkSchedule::LinkSchedule(Topology &topo,
+                           const string &filename)
+    : EventSource("LinkSchedule"),
+    _topo(topo)
+{
+    ifstream in(filename.c_str());
+    if (!in) {
+        cerr << "Error opening link schedule: " << filename << endl;
+        exit(1);
+    }
+
+    string line, when, name, what;
+    while (getline(in, line)) {
+        istringstream fields(line.substr(0, line.find('#')));
+        if (!(fields >> when >> name >> what)) {
+            continue;
+        }
+
+        Change c;
+        c.when = parseTime(when);
+        c.speed = 0;
+        c.up = (what != "down");
+
+        if (!_topo.findLink(name, c.link)) {
+            cerr << "Unknown link in schedule: " << name << endl;
+            exit(1);
+        }
+        if (what != "down" && what != "up") {
+            c.speed = speedFromGbps(stod(what));
+        }
+
+        _changes.push_back(c);
+    }
+
+    stable_sort(_changes.begin(), _changes.end(),
+            [](const Change &a, const Change &b) {return a.when < b.when;});
+
+    if (!_changes.empty()) {
+        EventList::Get().sourceIsPending(*this, _changes.front().when);
+    }
+}
+
+void
+LinkSchedule::doNextEvent()
+{
+    simtime_picosec now = EventList::Get().now();
+
+    while (!_changes.empty() && _changes.front().when <= now) {
+        Change &c = _changes.front();
+
+        cerr << "t=" << timeAsMs(now) << "ms " << _topo.linkName(c.link);
+        if (c.speed > 0) {
+            _topo.setLinkRate(c.link, c.speed);
+            cerr << " " << speedAsGbps(c.speed) << "G" << endl;
+        } else {
+            _topo.setLinkUp(c.link, c.up);
+            cerr << (c.up ? " up" : " down") << endl;
+        }
+        _changes.pop_front();
+    }
+
+    if (!_changes.empty()) {
+        EventList::Get().sourceIsPending(*this, _changes.front().when);
+    }
+}
@@ -0,0 +1,332 @@
+/*
+ * Topology builder header
+ */
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "eventlist.h"
+#include "logfile.h"
+#include "network.h"
+#include "queue.h"
+#include "pipe.h"
+#include "test.h"
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Topology;
+
+/*
+ * Stands in for the queue or the pipe of a deferred link in routes, and
+ * has the topology create the link when the first packet reaches it.
+ */
+class LinkProxy : public PacketSink
+{
+    public:
+        LinkProxy(Topology *topo, uint32_t link, bool pipe)
+            : _topo(topo), _link(link), _pipe(pipe) {}
+        void receivePacket(Packet &pkt);
+
+    private:
+        Topology *_topo;
+        uint32_t _link;
+        bool _pipe;
+};
+
+/*
+ * Builds leaf-spine and 3-tier Clos fabrics of any size.
+ *
+ * Every unidirectional link is a Queue followed by a Pipe. Links are kept
+ * in flat arrays addressed by a link index, with one contiguous block per
+ * link class, so routes and experiments look links up arithmetically
+ * instead of through nested containers. Names are not stored on the
+ * objects: linkName() formats them on demand, and nameLink() attaches
+ * them only to the links that logging actually needs.
+ *
+ * With lazy=1 (the default) server facing links are not created by build().
+ * Routes get a LinkProxy for them instead, and the link is created when the
+ * first packet crosses it, so idle servers cost two small proxies each.
+ *
+ * The fabric is described by key=value arguments (see configure()), taken
+ * from an optional --topofile and then from the command line.
+ *
+ * Links can be slowed down or failed mid-run (see LinkSchedule). A failed
+ * link drops everything sent into it, and interned routes through it are
+ * moved to a live path between the same servers, as ECMP rehashing would.
+ */
+class Topology
+{
+    public:
+        /* Classes of unidirectional links, in the order they are laid out. */
+        enum LinkClass {
+            HOST_UP,   // Server -> leaf/ToR
+            HOST_DOWN, // Leaf/ToR -> server
+            EDGE_UP,   // Leaf -> spine, ToR -> agg
+            EDGE_DOWN, // Spine -> leaf, agg -> ToR
+            CORE_UP,   // Agg -> core (Clos only)
+            CORE_DOWN, // Core -> agg (Clos only)
+            N_LINK_CLASSES
+        };
+
+        /* Most links on any path between two servers. */
+        static const uint32_t MAX_PATH_LINKS = 6;
+
+        /* Creates the queue of a link, given the queue type, rate and buffer. */
+        typedef std::function<Queue*(const std::string &, linkspeed_bps, mem_b)> queue_factory_t;
+
+        /* Creates the topology described by args on top of defaults. */
+        static Topology* create(const ArgList &defaults, const ArgList &args);
+
+        virtual ~Topology() {}
+
+        /* Instantiates all queues and pipes. */
+        void build(queue_factory_t factory = NULL);
+
+        /* Number of servers and links in the fabric. */
+        inline uint32_t nHosts() const {return _nHosts;}
+        inline uint32_t nLinks() const {return _base[N_LINK_CLASSES];}
+        inline uint32_t nLinks(LinkClass lc) const {return _base[lc + 1] - _base[lc];}
+        inline uint32_t hostsPerRack() const {return _nServer;}
+        inline uint32_t rack(uint32_t host) const {return host / _nServer;}
+
+        /* Link rate and class of a link. */
+        inline linkspeed_bps speed(LinkClass lc) const {return _speed[lc];}
+        LinkClass linkClass(uint32_t link) const;
+
+        /* Server facing links. */
+        inline uint32_t hostUp(uint32_t host) const {return _base[HOST_UP] + host;}
+        inline uint32_t hostDown(uint32_t host) const {return _base[HOST_DOWN] + host;}
+
+        /* Queue and pipe of a link, NULL while the link is deferred. */
+        inline Queue* queue(uint32_t link) const {return _queues[link];}
+        inline Pipe* pipe(uint32_t link) const {return _pipes[link];}
+
+        /* Whether a link has been created. */
+        inline bool built(uint32_t link) const {return _queues[link] != NULL;}
+
+        /* Creates a deferred link. */
+        void instantiate(uint32_t link);
+
+        /* Number of equal-cost paths between two hosts in different racks. */
+        virtual uint32_t nPaths() const = 0;
+
+        /* Fills links with the links from src to dst through the given path,
+         * and returns how many there are (at most MAX_PATH_LINKS). */
+        virtual uint32_t pathLinks(uint32_t src, uint32_t dst, uint32_t path, uint32_t *links) const = 0;
+
+        /* Appends the hops from src to dst through the given path to route. */
+        void appendRoute(route_t &route, uint32_t src, uint32_t dst, uint32_t path) const;
+
+        /* Whether every link from src to dst through the given path is up. */
+        bool pathUp(uint32_t src, uint32_t dst, uint32_t path) const;
+
+        /* Interned hops from src to dst through the given path. The route is
+         * built on first request and shared by every later flow on it. */
+        const route_t* route(uint32_t src, uint32_t dst, uint32_t path);
+
+        /* Counts the link events that moved interned routes. A flow that
+         * resolved its route at an older count may be on a dead path, and
+         * asks for its route again (see DataSource::refreshRoutes()). */
+        static inline uint32_t routeEpoch() {return _routeEpoch;}
+
+        /* Name of the queue of a link; the pipe name is derived from it. */
+        virtual std::string linkName(uint32_t link) const = 0;
+        virtual std::string pipeName(uint32_t link) const = 0;
+
+        /* Finds a link by its queue name. Returns false if there is none. */
+        bool findLink(const std::string &name, uint32_t &link) const;
+
+        /* Changes the rate of a link, or fails and restores it. */
+        void setLinkRate(uint32_t link, linkspeed_bps speed);
+        void setLinkUp(uint32_t link, bool up);
+        inline bool linkUp(uint32_t link) const {return !_down[link];}
+
+        /* Sets the name of a link's queue and pipe and records them in logfile. */
+        void nameLink(uint32_t link, Logfile *logfile);
+
+        /* Names every link, if the topology was configured with names=1.
+         * Deferred links are named in logfile when they are created. */
+        void writeNames(Logfile &logfile);
+
+        void printSummary();
+
+    protected:
+        Topology();
+
+        /* Reads the generic parameters shared by all topology types. */
+        virtual void configure(const ArgList &args);
+
+        /* Sets the size of each link class block. */
+        void layout(const uint32_t *count);
+
+        /* The given path if it is up, otherwise the next live one (if any). */
+        uint32_t livePath(uint32_t src, uint32_t dst, uint32_t path) const;
+
+        /* Moves interned routes off failed links, and back once repaired.
+         * Flows started afterwards take the new routes, running flows when
+         * they next refresh theirs. */
+        void reroute();
+
+        // Interns the hops from src to dst through the given path, noting
+        // the lists with proxy hops for instantiate() to update.
+        void internHops(route_t &hops, uint32_t src, uint32_t dst, uint32_t path);
+
+        inline void appendLink(route_t &route, uint32_t link) const {
+            if (_queues[link] != NULL) {
+                route.push_back(_queues[link]);
+                route.push_back(_pipes[link]);
+            } else {
+                uint32_t p = 2 * (link - _base[HOST_UP]);
+                route.push_back(&_proxies[p]);
+                route.push_back(&_proxies[p + 1]);
+            }
+        }
+
+        std::string _type;             // Topology type.
+        uint32_t _nServer;             // Servers per leaf/ToR.
+        uint32_t _nHosts;              // Total servers.
+        double _oversub;               // Leaf/ToR oversubscription ratio.
+        bool _names;                   // Name every link when built.
+        bool _lazy;                    // Defer server facing links to first use.
+        simtime_picosec _linkDelay;    // Propagation delay of every link.
+
+        // Per link class configuration.
+        linkspeed_bps _speed[N_LINK_CLASSES];
+        mem_b _buffer[N_LINK_CLASSES];
+        std::string _qtype[N_LINK_CLASSES];
+
+        // First link index of each class; _base[N_LINK_CLASSES] is the total.
+        uint32_t _base[N_LINK_CLASSES + 1];
+
+        // Flat, index-addressed link arrays.
+        std::vector<Queue*> _queues;
+        std::vector<Pipe*> _pipes;
+        std::vector<bool> _down;
+
+        // Queue and pipe stand-ins of every server facing link, when lazy.
+        mutable std::vector<LinkProxy> _proxies;
+
+        // Interned hop lists holding the proxies of each server facing
+        // link, until it is built.
+        std::vector<std::vector<route_t*> > _proxyRoutes;
+
+        // Interned route of a (src, dst, path): the live path it takes and
+        // its hop list.
+        struct InternedRoute {
+            uint32_t live;
+            route_t *hops;
+        };
+
+        // Interned routes, keyed by (src, dst, path).
+        std::unordered_map<uint64_t, InternedRoute> _routes;
+
+        // Every hop list handed out. A reroute interns a new list and keeps
+        // the old one, which packets in flight still point at.
+        std::deque<route_t> _hopLists;
+
+        static uint32_t _routeEpoch;
+
+        // Used to create and name deferred links.
+        queue_factory_t _factory;
+        Logfile *_logfile;
+        uint32_t _nBuilt;
+};
+
+/*
+ * Two-tier leaf-spine fabric: every leaf connects to every spine.
+ */
+class LeafSpineTopology : public Topology
+{
+    public:
+        uint32_t nPaths() const {return _nSpine;}
+        uint32_t pathLinks(uint32_t src, uint32_t dst, uint32_t path, uint32_t *links) const;
+        std::string linkName(uint32_t link) const;
+        std::string pipeName(uint32_t link) const;
+
+        inline uint32_t nLeaf() const {return _nLeaf;}
+        inline uint32_t nSpine() const {return _nSpine;}
+
+        inline uint32_t leafUp(uint32_t leaf, uint32_t spine) const {
+            return _base[EDGE_UP] + leaf * _nSpine + spine;
+        }
+        inline uint32_t spineDown(uint32_t spine, uint32_t leaf) const {
+            return _base[EDGE_DOWN] + spine * _nLeaf + leaf;
+        }
+
+    protected:
+        friend class Topology;
+        LeafSpineTopology() {}
+        void configure(const ArgList &args);
+
+        uint32_t _nLeaf;
+        uint32_t _nSpine;
+};
+
+/*
+ * Three-tier Clos (fat-tree) fabric of pods. Each ToR connects to every
+ * agg in its pod, and agg j of every pod shares the same group of cores.
+ */
+class ClosTopology : public Topology
+{
+    public:
+        uint32_t nPaths() const {return _nAgg * _nUplink;}
+        uint32_t pathLinks(uint32_t src, uint32_t dst, uint32_t path, uint32_t *links) const;
+        std::string linkName(uint32_t link) const;
+        std::string pipeName(uint32_t link) const;
+
+        inline uint32_t torAgg(uint32_t pod, uint32_t agg, uint32_t tor) const {
+            return _base[EDGE_UP] + (pod * _nAgg + agg) * _nTor + tor;
+        }
+        inline uint32_t aggTor(uint32_t pod, uint32_t agg, uint32_t tor) const {
+            return _base[EDGE_DOWN] + (pod * _nAgg + agg) * _nTor + tor;
+        }
+        inline uint32_t aggCore(uint32_t pod, uint32_t agg, uint32_t uplink) const {
+            return _base[CORE_UP] + (pod * _nAgg + agg) * _nUplink + uplink;
+        }
+        inline uint32_t coreAgg(uint32_t pod, uint32_t agg, uint32_t uplink) const {
+            return _base[CORE_DOWN] + (pod * _nAgg + agg) * _nUplink + uplink;
+        }
+
+    protected:
+        friend class Topology;
+        ClosTopology() {}
+        void configure(const ArgList &args);
+
+        // Splits a link index into its [pod/tree][agg/tor][k] indices.
+        void linkIndices(uint32_t link, uint32_t &i, uint32_t &j, uint32_t &k) const;
+
+        uint32_t _nPod;
+        uint32_t _nTor;    // Per pod.
+        uint32_t _nAgg;    // Per pod.
+        uint32_t _nUplink; // From each agg to the core.
+};
+
+/*
+ * Timed link changes, read from a file with one change per line:
+ *     <time> <link name> <rate>|down|up
+ * e.g. "2s L3_C7_up 10" drops that link to 10Gbps at t=2s and
+ * "5s C5_L10_down down" fails a link. Times take an s, ms or us suffix
+ * (us by default) and rates are in Gbps.
+ */
+class LinkSchedule : public EventSource
+{
+    public:
+        LinkSchedule(Topology &topo, const std::string &filename);
+        void doNextEvent();
+
+    private:
+        struct Change {
+            simtime_picosec when;
+            uint32_t link;
+            linkspeed_bps speed; // 0 for a failure or repair.
+            bool up;
+        };
+
+        Topology &_topo;
+        std::deque<Change> _changes; // Sorted by time.
+};
+
+#endif /* TOPOLOGY_H */
@@ -0,0 +1,202 @@
+/*
+ * Traffic matrix
+ */
+#include "traffic.h"
+
+#include <algorithm>
+
+using namespace std;
+
+TrafficMatrix::TrafficMatrix(Pattern pattern,
+                             uint32_t nHosts,
+                             uint32_t hostsPerRack)
+    : _pattern(pattern),
+    _nHosts(nHosts),
+    _hostsPerRack(hostsPerRack),
+    _fanin(min(16u, nHosts - 1)),
+    _hotFrac(0.5)
+{
+    assert(nHosts >= 2);
+
+    _hosts.resize(nHosts);
+    for (uint32_t i = 0; i < nHosts; i++) {
+        _hosts[i] = i;
+    }
+
+    if (_pattern == PERMUTATION) {
+        // Pair racks, or hosts in a single rack, along a random cycle so
+        // that none is its own peer.
+        uint32_t n = (nHosts > hostsPerRack) ? nHosts / hostsPerRack : nHosts;
+        vector<uint32_t> order(n);
+        for (uint32_t i = 0; i < n; i++) {
+            order[i] = i;
+        }
+        for (uint32_t i = n - 1; i > 0; i--) {
+            swap(order[i], order[rand() % (i + 1)]);
+        }
+
+        _peer.resize(n);
+        for (uint32_t i = 0; i < n; i++) {
+            _peer[order[i]] = order[(i + 1) % n];
+        }
+    } else if (_pattern == HOTSPOT) {
+        setHotspot(max(1u, nHosts / 64), _hotFrac);
+    }
+}
+
+TrafficMatrix*
+TrafficMatrix::create(const string &name,
+                      const Topology &topo,
+                      const ArgList &args)
+{
+    Pattern pattern;
+    if (name == "permutation") {
+        pattern = PERMUTATION;
+    } else if (name == "hotspot") {
+        pattern = HOTSPOT;
+    } else if (name == "incast") {
+        pattern = INCAST;
+    } else if (name == "alltoall") {
+        pattern = ALLTOALL;
+    } else {
+        fprintf(stderr, "Unknown traffic pattern: %s\n", name.c_str());
+        exit(1);
+    }
+
+    TrafficMatrix *tm = new TrafficMatrix(pattern, topo.nHosts(), topo.hostsPerRack());
+
+    uint32_t fanin = tm->_fanin;
+    parseInt(args, "fanin", fanin);
+    tm->setFanin(fanin);
+
+    if (pattern == HOTSPOT) {
+        uint32_t nHot = tm->_hot.size();
+        double hotFrac = tm->_hotFrac;
+        parseInt(args, "hotspots", nHot);
+        parseDouble(args, "hotfrac", hotFrac);
+        tm->setHotspot(nHot, hotFrac);
+    }
+
+    return tm;
+}
+
+vector<pair<string, double> >
+TrafficMatrix::parseList(const string &list)
+{
+    vector<pair<string, double> > patterns;
+
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == string::npos) {
+            end = list.size();
+        }
+
+        string item = list.substr(start, end - start);
+        size_t colon = item.find(':');
+        if (colon == string::npos) {
+            fprintf(stderr, "Traffic pattern needs a load share: %s\n", item.c_str());
+            exit(1);
+        }
+        patterns.push_back(make_pair(item.substr(0, colon), stod(item.substr(colon + 1))));
+
+        start = end + 1;
+    }
+
+    return patterns;
+}
+
+void
+TrafficMatrix::setFanin(uint32_t fanin)
+{
+    // An incast needs one host to spare for the receiver.
+    uint32_t most = (_pattern == INCAST) ? _nHosts - 1 : _nHosts;
+    _fanin = max(_pattern == ALLTOALL ? 2u : 1u, min(fanin, most));
+}
+
+void
+TrafficMatrix::setHotspot(uint32_t nHot,
+                          double hotFrac)
+{
+    nHot = min(max(nHot, 1u), _nHosts);
+    pickHosts(nHot);
+    _hot.assign(_hosts.begin(), _hosts.begin() + nHot);
+    _hotFrac = hotFrac;
+}
+
+uint32_t
+TrafficMatrix::flowsPerArrival() const
+{
+    switch (_pattern) {
+        case INCAST:
+            return _fanin;
+        case ALLTOALL:
+            return _fanin * (_fanin - 1);
+        default:
+            return 1;
+    }
+}
+
+void
+TrafficMatrix::pickHosts(uint32_t n)
+{
+    // Partial Fisher-Yates: _hosts stays a permutation of every host.
+    for (uint32_t i = 0; i < n; i++) {
+        swap(_hosts[i], _hosts[i + rand() % (_nHosts - i)]);
+    }
+}
+
+uint32_t
+TrafficMatrix::otherHost(uint32_t host)
+{
+    uint32_t other = rand() % (_nHosts - 1);
+    return (other >= host) ? other + 1 : other;
+}
+
+void
+TrafficMatrix::next(vector<pair<uint32_t, uint32_t> > &flows)
+{
+    flows.clear();
+
+    switch (_pattern) {
+        case PERMUTATION: {
+            uint32_t src = rand() % _nHosts;
+            uint32_t dst;
+            if (_peer.size() == _nHosts) {
+                dst = _peer[src];
+            } else {
+                uint32_t rack = _peer[src / _hostsPerRack];
+                dst = rack * _hostsPerRack + rand() % _hostsPerRack;
+            }
+            flows.push_back(make_pair(src, dst));
+            break;
+        }
+
+        case HOTSPOT: {
+            uint32_t dst = (drand() < _hotFrac) ? _hot[rand() % _hot.size()] : rand() % _nHosts;
+            flows.push_back(make_pair(otherHost(dst), dst));
+            break;
+        }
+
+        case INCAST: {
+            // The first host picked receives, the next fanin send.
+            pickHosts(_fanin + 1);
+            for (uint32_t i = 1; i <= _fanin; i++) {
+                flows.push_back(make_pair(_hosts[i], _hosts[0]));
+            }
+            break;
+        }
+
+        case ALLTOALL: {
+            pickHosts(_fanin);
+            for (uint32_t i = 0; i < _fanin; i++) {
+                for (uint32_t j = 0; j < _fanin; j++) {
+                    if (i != j) {
+                        flows.push_back(make_pair(_hosts[i], _hosts[j]));
+                    }
+                }
+            }
+            break;
+        }
+    }
+}
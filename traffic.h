@@ -0,0 +1,86 @@
+/*
+ * Traffic matrix header
+ */
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include "topology.h"
+#include "test.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Chooses the hosts of the flows a FlowGenerator starts on each arrival.
+ *
+ *  PERMUTATION  one flow to a host in the source's peer rack. Racks are
+ *               paired by a random derangement fixed at the start (hosts
+ *               are, if there is a single rack).
+ *  HOTSPOT      one flow, to one of a few hot hosts with probability
+ *               hotfrac and to any host otherwise.
+ *  INCAST       a job of fanin flows from distinct senders to one
+ *               receiver, as in partition/aggregate.
+ *  ALLTOALL     a job among fanin hosts, each sending to all the others,
+ *               as in a shuffle.
+ *
+ * Sources are uniform over the hosts. The flows of a job arrive together
+ * and are tracked as a coflow by the generator, which reports the job's
+ * completion time along with the FCT of its flows.
+ */
+class TrafficMatrix
+{
+    public:
+        enum Pattern {
+            PERMUTATION,
+            HOTSPOT,
+            INCAST,
+            ALLTOALL
+        };
+
+        TrafficMatrix(Pattern pattern, uint32_t nHosts, uint32_t hostsPerRack);
+
+        // The pattern called name, with its settings (fanin, hotspots,
+        // hotfrac) from args. Exits on an unknown name.
+        static TrafficMatrix* create(const std::string &name, const Topology &topo,
+                const ArgList &args);
+
+        // Splits a --traffic list such as "incast:0.2,permutation:0.1" into
+        // pattern names and their shares of the offered load.
+        static std::vector<std::pair<std::string, double> > parseList(const std::string &list);
+
+        // Senders per incast job, or hosts per all-to-all job.
+        void setFanin(uint32_t fanin);
+
+        // Number of hot hosts, and the share of flows sent to them.
+        void setHotspot(uint32_t nHot, double hotFrac);
+
+        // Whether arrivals are jobs, and how many flows each arrival starts.
+        inline bool isJob() const {return _pattern == INCAST || _pattern == ALLTOALL;}
+        uint32_t flowsPerArrival() const;
+
+        // Fills flows with the (src, dst) hosts of the next arrival.
+        void next(std::vector<std::pair<uint32_t, uint32_t> > &flows);
+
+    private:
+        // Moves n distinct random hosts to the front of _hosts.
+        void pickHosts(uint32_t n);
+
+        // Random host other than host.
+        uint32_t otherHost(uint32_t host);
+
+        Pattern _pattern;
+        uint32_t _nHosts;
+        uint32_t _hostsPerRack;
+        uint32_t _fanin;
+        double _hotFrac;
+
+        // Every host once, in an order that pickHosts() shuffles.
+        std::vector<uint32_t> _hosts;
+
+        // Peer of each rack (or host) for permutations, hot hosts otherwise.
+        std::vector<uint32_t> _peer;
+        std::vector<uint32_t> _hot;
+};
+
+#endif /* TRAFFIC_H */
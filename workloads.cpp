@@ -3,24 +3,245 @@
  */
 #include "workloads.h"
 
+#include <algorithm>
+#include <map>
+
+#include <sys/stat.h>
+
 using namespace std;
 
-Workloads::Workloads(uint32_t avgFlowSize, 
-                     FlowDist flowSizeDist)
-                    : _avgFlowSize(avgFlowSize),
-                    _flowSizeDist(flowSizeDist)
+// Marks a compiled CDF cache file, and its layout version.
+static const char CDF_CACHE_MAGIC[8] = {'h', 't', 's', 'c', 'd', 'f', '0', '1'};
+
+// Header of a compiled CDF cache. The source file's size and modification
+// time tell whether the cache is stale.
+struct CDFCacheHeader {
+    char magic[8];
+    uint64_t srcSize;
+    int64_t srcMtime;
+    uint32_t n;
+};
+
+FlowSizeCDF::FlowSizeCDF(const uint64_t *sizes,
+                         const double *probs,
+                         uint32_t n)
+    : _prob(probs, probs + n),
+    _size(sizes, sizes + n),
+    _nBuckets(4 * n),
+    _last(n - 2)
+{
+    assert(n >= 2);
+
+    // Bucket b starts after the last point that falls in an earlier bucket.
+    // Comparing buckets rather than probabilities keeps this exact under
+    // rounding of u * _nBuckets.
+    _guide.resize(_nBuckets);
+    uint32_t i = 0;
+    for (uint32_t b = 0; b < _nBuckets; b++) {
+        while (i < _last && (uint32_t)(_prob[i + 1] * _nBuckets) < b) {
+            i++;
+        }
+        _guide[b] = i;
+    }
+}
+
+FlowSizeCDF
+FlowSizeCDF::load(const string &filename)
 {
-    if (_flowSizeDist == ENTERPRISE) {
-        _avgFlowSize = 215000;
-        for (uint32_t i = 0; i < sizeof(enterprise_size)/8; i++) {
-            _flowSizeCDF[enterprise_prob[i]] = enterprise_size[i];
+    vector<uint64_t> sizes;
+    vector<double> probs;
+
+    if (loadCache(filename, sizes, probs)) {
+        return FlowSizeCDF(sizes.data(), probs.data(), sizes.size());
+    }
+
+    FILE *fp = fopen(filename.c_str(), "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening CDF file: %s\n", filename.c_str());
+        exit(1);
+    }
+
+    char line[256];
+    uint32_t lineno = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        lineno++;
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
         }
-    } else if (_flowSizeDist == DATAMINING) {
-        _avgFlowSize = 12500000;
-        for (uint32_t i = 0; i < sizeof(datamining_size)/8; i++) {
-            _flowSizeCDF[datamining_prob[i]] = datamining_size[i];
+
+        double v[3];
+        int n = sscanf(line, "%lf %lf %lf", &v[0], &v[1], &v[2]);
+        if (n <= 0) {
+            continue;
+        }
+
+        double size = v[0], prob = v[n - 1];
+        if (n == 1 || size < 0 || prob < 0 || prob > 1 ||
+                (!sizes.empty() && (size < sizes.back() || prob < probs.back()))) {
+            fprintf(stderr, "Bad CDF point at %s:%u\n", filename.c_str(), lineno);
+            exit(1);
+        }
+
+        sizes.push_back(llround(size));
+        probs.push_back(prob);
+    }
+
+    fclose(fp);
+
+    if (sizes.size() < 2 || fabs(probs.back() - 1) > 1e-6) {
+        fprintf(stderr, "CDF in %s must have two points or more and end at 1\n",
+                filename.c_str());
+        exit(1);
+    }
+    probs.back() = 1.0;
+
+    saveCache(filename, sizes, probs);
+    return FlowSizeCDF(sizes.data(), probs.data(), sizes.size());
+}
+
+bool
+FlowSizeCDF::loadCache(const string &filename,
+                       vector<uint64_t> &sizes,
+                       vector<double> &probs)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+
+    FILE *fp = fopen((filename + ".bin").c_str(), "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    CDFCacheHeader h;
+    bool ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+        memcmp(h.magic, CDF_CACHE_MAGIC, sizeof(h.magic)) == 0 &&
+        h.srcSize == (uint64_t)st.st_size && h.srcMtime == (int64_t)st.st_mtime && h.n >= 2;
+
+    if (ok) {
+        sizes.resize(h.n);
+        probs.resize(h.n);
+        ok = fread(sizes.data(), sizeof(sizes[0]), h.n, fp) == h.n &&
+            fread(probs.data(), sizeof(probs[0]), h.n, fp) == h.n;
+    }
+
+    fclose(fp);
+    return ok;
+}
+
+void
+FlowSizeCDF::saveCache(const string &filename,
+                       const vector<uint64_t> &sizes,
+                       const vector<double> &probs)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return;
+    }
+
+    // The cache is only an optimization, so failing to write it is fine.
+    FILE *fp = fopen((filename + ".bin").c_str(), "wb");
+    if (fp == NULL) {
+        return;
+    }
+
+    CDFCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CDF_CACHE_MAGIC, sizeof(h.magic));
+    h.srcSize = st.st_size;
+    h.srcMtime = st.st_mtime;
+    h.n = sizes.size();
+
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(sizes.data(), sizeof(sizes[0]), h.n, fp);
+    fwrite(probs.data(), sizeof(probs[0]), h.n, fp);
+    fclose(fp);
+}
+
+double
+FlowSizeCDF::mean() const
+{
+    // Samples below the first point take its size. Sizes are uniform
+    // within a segment, so each adds its midpoint.
+    double m = _prob[0] * _size[0];
+    for (uint32_t i = 0; i <= _last; i++) {
+        m += (_prob[i + 1] - _prob[i]) * (_size[i] + _size[i + 1]) / 2.0;
+    }
+    return m;
+}
+
+// Named workloads. std::map keeps the CDFs in place as more are added.
+static map<string, FlowSizeCDF>&
+cdfRegistry()
+{
+    static map<string, FlowSizeCDF> registry;
+    return registry;
+}
+
+void
+Workloads::registerCDF(const string &name,
+                       const FlowSizeCDF &cdf)
+{
+    cdfRegistry()[name] = cdf;
+}
+
+const FlowSizeCDF*
+Workloads::namedCDF(const string &name)
+{
+    map<string, FlowSizeCDF> &registry = cdfRegistry();
+
+    auto it = registry.find(name);
+    if (it != registry.end()) {
+        return &it->second;
+    }
+
+    if (name == "enterprise") {
+        registerCDF(name, FlowSizeCDF(enterprise_size, enterprise_prob,
+                    sizeof(enterprise_size) / sizeof(enterprise_size[0])));
+    } else if (name == "datamining") {
+        registerCDF(name, FlowSizeCDF(datamining_size, datamining_prob,
+                    sizeof(datamining_size) / sizeof(datamining_size[0])));
+    } else {
+        struct stat st;
+        if (stat(name.c_str(), &st) != 0) {
+            return NULL;
         }
+        registerCDF(name, FlowSizeCDF::load(name));
+    }
+
+    return &registry[name];
+}
+
+Workloads::Workloads(uint32_t avgFlowSize, 
+                     const string &flowSizeDist)
+                    : _avgFlowSize(avgFlowSize),
+                    _flowSizeDist(UNIFORM),
+                    _flowSizeCDF(NULL)
+{
+    if (flowSizeDist == "uniform") {
+        return;
+    } else if (flowSizeDist == "pareto") {
+        _flowSizeDist = PARETO;
+        return;
+    }
+
+    _flowSizeCDF = namedCDF(flowSizeDist);
+    if (_flowSizeCDF == NULL) {
+        fprintf(stderr, "Unknown flow size distribution: %s\n", flowSizeDist.c_str());
+        exit(1);
+    }
+
+    if (flowSizeDist == "enterprise") {
+        _flowSizeDist = ENTERPRISE;
+    } else if (flowSizeDist == "datamining") {
+        _flowSizeDist = DATAMINING;
+    } else {
+        _flowSizeDist = CDF;
     }
+    _avgFlowSize = llround(_flowSizeCDF->mean());
 }
 
 uint64_t
@@ -33,21 +254,62 @@ Workloads::generateFlowSize()
 
         case ENTERPRISE:
         case DATAMINING:
-            // Custom workload, generate using _flowSizeCDF.
-            break;
+        case CDF:
+            // Empirical workload, generate using _flowSizeCDF.
+            return _flowSizeCDF->sample(drand());
+
+        default: // UNIFORM
+            return _avgFlowSize;
+    }
+}
+
+uint64_t
+Workloads::flowSize(double u) const
+{
+    switch (_flowSizeDist) {
+        case PARETO: {
+            double scale = _avgFlowSize * (1.1 - 1) / 1.1;
+            return (uint64_t)(scale / pow(u, 1 / 1.1));
+        }
+
+        case ENTERPRISE:
+        case DATAMINING:
+        case CDF:
+            return _flowSizeCDF->sample(u);
 
         default: // UNIFORM
             return _avgFlowSize;
     }
+}
+
+void
+Workloads::generateFlowSizes(uint64_t *sizes,
+                             uint32_t n)
+{
+    switch (_flowSizeDist) {
+        case PARETO:
+            for (uint32_t i = 0; i < n; i++) {
+                sizes[i] = (uint64_t)pareto(1.1, _avgFlowSize);
+            }
+            return;
 
-    double random = drand();
-    auto it = _flowSizeCDF.upper_bound(random);
-    double rp = it->first;
-    uint64_t rv = it->second;
-    it = prev(it);
-    double lp = it->first;
-    uint64_t lv = it->second;
+        case ENTERPRISE:
+        case DATAMINING:
+        case CDF: {
+            // Draw all the probabilities first, then look them up, so the
+            // lookup loop does not wait on the generator.
+            vector<double> u(n);
+            for (uint32_t i = 0; i < n; i++) {
+                u[i] = drand();
+            }
+            for (uint32_t i = 0; i < n; i++) {
+                sizes[i] = _flowSizeCDF->sample(u[i]);
+            }
+            return;
+        }
 
-    uint64_t flowsize = lv + (rv - lv) * (random - lp) / (rp - lp);
-    return flowsize;
+        default: // UNIFORM
+            fill(sizes, sizes + n, (uint64_t)_avgFlowSize);
+            return;
+    }
 }
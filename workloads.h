@@ -5,7 +5,68 @@
 #define WORKLOADS_H
 
 #include "htsim.h"
-#include <map>
+
+#include <string>
+#include <vector>
+
+/*
+ * Empirical flow size distribution, compiled for constant time sampling.
+ *
+ * The CDF is kept as flat arrays of points, with sizes interpolated linearly
+ * between them. A guide table splits [0,1] into equal buckets and stores,
+ * for each bucket, the last point known to lie below it; a sample starts
+ * there and steps forward past the few points sharing its bucket. With a
+ * few buckets per point the step loop runs about once per sample, even for
+ * CDFs as skewed as the enterprise one.
+ */
+class FlowSizeCDF
+{
+    public:
+        FlowSizeCDF() {}
+        FlowSizeCDF(const uint64_t *sizes, const double *probs, uint32_t n);
+
+        // Reads a CDF file: one "size probability" point per line, sizes in
+        // bytes, both non-decreasing and ending at probability 1. Lines may
+        // carry a middle column (as in "size count probability" files),
+        // which is ignored; '#' starts a comment. The compiled points are
+        // cached next to the file in filename.bin, which is used instead of
+        // the text for as long as it is newer.
+        static FlowSizeCDF load(const std::string &filename);
+
+        // Mean flow size in bytes, with sizes interpolated as in sample().
+        double mean() const;
+
+        // Flow size at cumulative probability u.
+        inline uint64_t sample(double u) const {
+            uint32_t b = (uint32_t)(u * _nBuckets);
+            uint32_t i = _guide[b < _nBuckets ? b : _nBuckets - 1];
+            while (i < _last && _prob[i + 1] <= u) {
+                i++;
+            }
+
+            double lp = _prob[i], rp = _prob[i + 1];
+            uint64_t lv = _size[i], rv = _size[i + 1];
+            if (u <= lp) {
+                return lv;
+            }
+            if (u >= rp) {
+                return rv;
+            }
+            return lv + (rv - lv) * (u - lp) / (rp - lp);
+        }
+
+    private:
+        static bool loadCache(const std::string &filename, std::vector<uint64_t> &sizes,
+                std::vector<double> &probs);
+        static void saveCache(const std::string &filename, const std::vector<uint64_t> &sizes,
+                const std::vector<double> &probs);
+
+        std::vector<double> _prob;
+        std::vector<uint64_t> _size;
+        std::vector<uint32_t> _guide;
+        uint32_t _nBuckets;
+        uint32_t _last;               // Index of the last segment.
+};
 
 class Workloads
 {
@@ -15,19 +76,38 @@ class Workloads
             UNIFORM,    // All flows are of the same size
             PARETO,     // Pareto distributed with shape (alpha) 1.2
             ENTERPRISE, // Enterprise workload from CONGA paper.
-            DATAMINING  // Datamining workload from CONGA paper.
+            DATAMINING, // Datamining workload from CONGA paper.
+            CDF         // Empirical CDF registered by name or read from a file.
         };
 
-        Workloads(uint32_t avgFlowSize, FlowDist flowSizeDist);
+        // The distribution is named uniform, pareto, enterprise, datamining,
+        // a workload added with registerCDF(), or the path of a CDF file.
+        // avgFlowSize is used by uniform and pareto only; the others report
+        // the mean of their CDF.
+        Workloads(uint32_t avgFlowSize, const std::string &flowSizeDist);
+
+        // Makes a CDF available as a named workload.
+        static void registerCDF(const std::string &name, const FlowSizeCDF &cdf);
 
         // Returns a flow size according to some distribution.
         uint64_t generateFlowSize();
 
+        // Flow size for a uniform draw u in (0,1], for callers with their
+        // own random stream. UNIFORM ignores u.
+        uint64_t flowSize(double u) const;
+
+        // Fills sizes with n flow sizes, the same as n generateFlowSize()
+        // calls but with the random draws and the lookups in separate loops.
+        void generateFlowSizes(uint64_t *sizes, uint32_t n);
+
         uint32_t _avgFlowSize;        // Average flowsize in bytes.
-        uint32_t _flowSizeDist;       // Distribution of flow size [0/1/2] - Uniform/Exp/Pareto.
+        FlowDist _flowSizeDist;       // Distribution of flow size.
+
+        // Empirical flow size distribution, shared by every user of the name.
+        const FlowSizeCDF *_flowSizeCDF;
 
-        // Custom flow size distribution.
-        std::map<double,uint64_t> _flowSizeCDF;
+    private:
+        static const FlowSizeCDF* namedCDF(const std::string &name);
 };
 
 